@@ -26,6 +26,7 @@
 #include "autoconf.h"
 #include "libc/types.h"
 #include "libflash.h"
+#include "libsig.h"
 
 #define LIBFW_DEBUG 0
 /***********************************************************
@@ -45,6 +46,25 @@
 
 uint32_t crc32 (const unsigned char *buf, uint32_t len, uint32_t init);
 
+/*
+ * Fused CRC32 + SHA256 digest. Both digests are updated in a single read of
+ * the content, instead of a crc32() pass followed by a hash pass.
+ * The CRC32 is the crc32() one (initial value 0xffffffff), and can be read
+ * (or reset) in the context at any time, the SHA256 covering the whole
+ * content since fw_fused_digest_init().
+ * Setting data to NULL updates the digests with size erased (0xff) bytes.
+ */
+typedef struct {
+    uint32_t       crc;
+    sha256_context sha;
+} fw_fused_digest_t;
+
+void fw_fused_digest_init(fw_fused_digest_t *ctx);
+
+void fw_fused_digest_update(fw_fused_digest_t *ctx, const uint8_t *data, uint32_t size);
+
+void fw_fused_digest_final(fw_fused_digest_t *ctx, uint32_t *crc, uint8_t hash[SHA256_DIGEST_SIZE]);
+
 
 /***********************************************************
  * Firmware current mode informational API
@@ -97,6 +117,11 @@ uint8_t firmware_init(void);
  * Firmware header manipulation functions
  */
 
+typedef enum {
+	PART_FLIP = 0,
+	PART_FLOP = 1,
+} partitions_types;
+
 #define FW_IV_LEN 16
 #define FW_HMAC_LEN 32
 
@@ -112,6 +137,20 @@ typedef struct __packed {
 	/* The signature goes here ... with a siglen length */
 } firmware_header_t;
 
+/*
+ * The header type field hold the target partition in its lower half-word.
+ * The upper half-word hold the image format flags.
+ */
+#define FW_TYPE_PARTITION_Msk 0x0000ffff
+/* sparse image: the payload starts with an extent table (see below) */
+#define FW_TYPE_SPARSE        0x00010000
+/* hash-tree authenticated chunks: the hmac field holds the tree root */
+#define FW_TYPE_MERKLE        0x00020000
+/* sector-diff update: the payload starts with a sector manifest (see below) */
+#define FW_TYPE_SECTOR_DIFF   0x00040000
+/* AES-CTR encrypted payload, using the header iv field (see below) */
+#define FW_TYPE_ENCRYPTED     0x00080000
+
 /**
  * \brief parse the given buffer (starting with the firmware header)
  *
@@ -145,6 +184,99 @@ bool firmware_is_partition_flip(__in const firmware_header_t *header);
 
 bool firmware_is_partition_flop(__in const firmware_header_t *header);
 
+bool firmware_is_sparse(__in const firmware_header_t *header);
+
+bool firmware_is_merkle(__in const firmware_header_t *header);
+
+bool firmware_is_sector_diff(__in const firmware_header_t *header);
+
+bool firmware_is_encrypted(__in const firmware_header_t *header);
+
+/*
+ * Sparse images
+ *
+ * A sparse image (FW_TYPE_SPARSE) only carries the data runs of the bank
+ * image, the gaps between them being left in their erased state.
+ * The payload (following the header and its signature) is structured as:
+ *
+ *   uint32_t          count;          (big endian)
+ *   firmware_extent_t extents[count]; (big endian fields)
+ *   data runs, concatenated in the extents order
+ *
+ * Extents are sorted, do not overlap and are word-aligned (only the last
+ * extent length may not be a multiple of 4).
+ * The header len field is still the full (expanded) image size, on which the
+ * image hash is calculated.
+ */
+typedef struct __packed {
+	uint32_t offset; /* from the bank base address */
+	uint32_t len;
+} firmware_extent_t;
+
+#define FW_EXTENT_TABLE_SIZE(count) (sizeof(uint32_t) + ((count) * sizeof(firmware_extent_t)))
+
+/**
+ * \brief parse the extent table at the begining of a sparse image payload
+ *
+ * \param buffer  the input buffer, starting with the extent table
+ * \param len     the input buffer len
+ * \param header  the (already parsed) firmware header
+ * \param extents the output extent table
+ * \param max     the output extent table max number of extents
+ * \param count   the number of extents fullfilled in the output table
+ *
+ * The extent table consume FW_EXTENT_TABLE_SIZE(count) bytes of the payload.
+ */
+int firmware_parse_extents(__in  const uint8_t           *buffer,
+                           __in  const uint32_t           len,
+                           __in  const firmware_header_t *header,
+                           __out firmware_extent_t       *extents,
+                           __in  const uint32_t           max,
+                           __out uint32_t                *count);
+
+/*
+ * Sector-diff images
+ *
+ * A sector-diff image (FW_TYPE_SECTOR_DIFF) payload starts with a sector
+ * manifest, followed by the remaining of the payload (including the extent
+ * table of sparse images):
+ *
+ *   uint32_t                 count;        (big endian)
+ *   firmware_sector_digest_t digests[count];
+ *
+ * digests[i] is the SHA256 of the whole i-th storage sector of the target
+ * bank (starting at the bank base address), as it is once the image is
+ * written (erased parts included). Sectors of the bank whose current content
+ * already matches their digest are neither erased nor programmed.
+ */
+#define FW_SECTOR_DIGEST_LEN 32
+#define FW_SECTOR_DIFF_MAX   64
+
+typedef struct __packed {
+	uint8_t digest[FW_SECTOR_DIGEST_LEN];
+} firmware_sector_digest_t;
+
+#define FW_SECTOR_MANIFEST_SIZE(count) (sizeof(uint32_t) + ((count) * sizeof(firmware_sector_digest_t)))
+
+/**
+ * \brief parse the sector manifest at the begining of a sector-diff image payload
+ *
+ * \param buffer  the input buffer, starting with the sector manifest
+ * \param len     the input buffer len
+ * \param header  the (already parsed) firmware header
+ * \param digests the output sector digests table
+ * \param max     the output table max number of digests
+ * \param count   the number of digests fullfilled in the output table
+ *
+ * The manifest consume FW_SECTOR_MANIFEST_SIZE(count) bytes of the payload.
+ */
+int firmware_parse_sector_manifest(__in  const uint8_t            *buffer,
+                                   __in  const uint32_t            len,
+                                   __in  const firmware_header_t  *header,
+                                   __out firmware_sector_digest_t *digests,
+                                   __in  const uint32_t            max,
+                                   __out uint32_t                 *count);
+
 /*
  * About firmware versioning
  */
@@ -163,7 +295,105 @@ bool fw_is_rollback(firmware_header_t *header);
 
 int fw_version_compare(uint32_t version1, uint32_t version2);
 
+/*
+ * Update admission
+ *
+ * Check, before anything is erased, that the header describes an image the
+ * device accepts: known type, targetting the other bank, fitting in the bank,
+ * with a supported signature len and not being a rollback (the running bank
+ * version being read once). Return FW_ADMIT_OK, or the first reject reason.
+ */
+typedef enum {
+    FW_ADMIT_OK = 0,
+    FW_REJECT_HEADER,       /* no header */
+    FW_REJECT_TYPE,         /* unknown or incompatible type flags */
+    FW_REJECT_MODE,         /* neither in flip nor in flop mode */
+    FW_REJECT_BANK,         /* the image doesn't target the other bank */
+    FW_REJECT_LEN,          /* null len, or larger than the bank */
+    FW_REJECT_SIGLEN,       /* null signature, or larger than EC_MAX_SIGLEN */
+    FW_REJECT_BOOTINFO,     /* the running bank bootinfo can't be read */
+    FW_REJECT_ROLLBACK,     /* version not newer than the running one */
+} fw_admit_t;
+
+fw_admit_t fw_update_admit(const firmware_header_t *header);
+
+const char *fw_admit_reason(fw_admit_t admit);
+
+
+
+/*
+ * Storage backend
+ *
+ * All the storage accesses of the libfirmware are made through a storage
+ * backend, described by the following operations. The default backend is
+ * the flash one (libflash and EwoK devices). Other backends can be used to
+ * work on another storage (e.g. external memory) or on the host.
+ */
+typedef enum {
+    FW_STORAGE_CTRL = 0,  /* storage controller */
+    FW_STORAGE_CTRL2,     /* storage controller, bootinfo access */
+    FW_STORAGE_FLIP,      /* flip bank content */
+    FW_STORAGE_FLOP,      /* flop bank content */
+    FW_STORAGE_FLIP_SHR,  /* flip bootinfo */
+    FW_STORAGE_FLOP_SHR,  /* flop bootinfo */
+} fw_storage_area_t;
+
+typedef struct {
+    /* map (resp. unmap) the area in the task memory. Mapping a controller
+     * area unlocks the storage for write, unmapping it lock it back. */
+    uint8_t (*map)(fw_storage_area_t area);
+    uint8_t (*unmap)(fw_storage_area_t area);
+    /* release the area, which will not be mapped anymore */
+    uint8_t (*release)(fw_storage_area_t area);
+    /* erase all the sectors overlapping [addr, addr + len[ */
+    uint8_t (*erase_range)(physaddr_t addr, uint32_t len);
+    /* return the size of the sector holding addr (0 if out of storage).
+     * Sectors are aligned on their size. */
+    uint32_t (*sector_size)(physaddr_t addr);
+    /* program size bytes at dest (NOR semantic: bits can only be cleared),
+     * src having no alignment constraint */
+    uint8_t (*program)(physaddr_t dest, const uint8_t *src, uint32_t size);
+    uint8_t (*read)(physaddr_t src, uint8_t *dest, uint32_t size);
+    /* return the address at which the storage content can be directly read */
+    const void *(*addr)(physaddr_t addr);
+    /* optional (both NULL if unsupported): start erasing the sector holding
+     * addr without waiting for its completion, erase_busy() returning true
+     * until the erase is done */
+    uint8_t (*erase_begin)(physaddr_t addr);
+    bool (*erase_busy)(void);
+} fw_storage_ops_t;
+
+uint8_t fw_storage_set_backend(const fw_storage_ops_t *ops);
+
+uint8_t fw_storage_read(physaddr_t src, uint8_t *dest, uint32_t size);
+
+/*
+ * RAM storage backend: the storage is emulated in the given memory, which
+ * hold the [base, base + size[ storage address space, base being sector_size
+ * aligned. Erase sets the overlapping sectors to 0xff, program only clears
+ * bits. A split sector erase (erase_begin()) is reported busy once, and done
+ * on the next erase_busy() call.
+ */
+uint8_t fw_storage_ram_init(uint8_t *mem, physaddr_t base, uint32_t size, uint32_t sector_size);
+
+extern const fw_storage_ops_t fw_storage_ram_ops;
+
+#if defined(__linux__)
+/*
+ * Memory-mapped file storage backend (host only): the storage is a raw
+ * image file holding the [base, base + size[ storage address space (created
+ * or grown with erased content if needed), handled as a RAM backend storage
+ * on the file mapping. The mapping is synced when an area is released and
+ * when the file is closed.
+ */
+uint8_t fw_storage_file_open(const char *path, physaddr_t base, uint32_t size, uint32_t sector_size);
+
+uint8_t fw_storage_file_sync(void);
+
+uint8_t fw_storage_file_close(void);
 
+extern const fw_storage_ops_t fw_storage_file_ops;
+#endif
 
 /*
  * Storage management (updating firmware)
@@ -171,16 +401,431 @@ int fw_version_compare(uint32_t version1, uint32_t version2);
 
 uint8_t fw_storage_erase_bank(void);
 
+/*
+ * Non-blocking bank erase. fw_storage_erase_start() schedules the erase of
+ * the other bank, which is then erased sector after sector by
+ * fw_storage_erase_poll() (typically called while waiting for the next
+ * chunk), so that the erase overlaps the chunks reception.
+ * The storage access must be prepared (fw_storage_prepare_access()) while
+ * sectors are erased. Writing in a not yet erased part of the bank first
+ * erases the sectors up to the written area, and fw_storage_finalize_access()
+ * erases the remaining sectors: the bank content is the same as with
+ * fw_storage_erase_bank().
+ */
+uint8_t fw_storage_erase_start(void);
+
+/*
+ * erase (at most) the next max_sectors sectors of the scheduled erase. With a
+ * backend providing erase_begin(), the sector erases are started without
+ * waiting, each poll completing the previous one. Otherwise (libflash), each
+ * sector erase blocks until it is done.
+ */
+uint8_t fw_storage_erase_poll(uint32_t max_sectors);
+
+bool fw_storage_erase_done(void);
+
+/*
+ * Sector-diff update. fw_storage_diff_start() compares the current content
+ * of each sector of the other bank with its manifest digest, then starts the
+ * scheduled bank erase (see fw_storage_erase_start()) skipping the identical
+ * sectors. Until fw_storage_finalize_access(), fw_storage_write_buffer()
+ * doesn't program the identical sectors either.
+ * The diff context must be kept by the caller until the access is finalized.
+ */
+typedef struct {
+    physaddr_t base;
+    uint32_t   count;
+    uint32_t   skipped;                       /* number of identical sectors */
+    bool       identical[FW_SECTOR_DIFF_MAX];
+} fw_sector_diff_t;
+
+uint8_t fw_storage_diff_start(fw_sector_diff_t *diff,
+                              const firmware_sector_digest_t *digests, uint32_t count);
+
 uint8_t fw_storage_prepare_access(void);
 
 uint8_t fw_storage_release_access(void);
 
 uint8_t fw_storage_write_buffer(physaddr_t dest, uint32_t *buffer, uint32_t size);
 
+#if CONFIG_USR_LIB_FIRMWARE_CHUNK_POOL
+/*
+ * Chunk buffers pool (USR_LIB_FIRMWARE_CHUNK_POOL). The library owns a fixed
+ * pool of word-aligned chunk buffers. A buffer is loaned with
+ * fw_chunk_acquire(), the chunk is received in it, then fw_chunk_commit()
+ * programs it in place and gives the buffer back (fw_chunk_release() gives
+ * it back without programming it). fw_chunk_acquire() returns NULL when all
+ * the buffers are loaned.
+ * The chunk size is the image header one, which must fit in a pool buffer.
+ */
+uint8_t fw_chunk_pool_init(const firmware_header_t *header);
+
+uint32_t fw_chunk_size(void);
+
+uint8_t *fw_chunk_acquire(void);
+
+uint8_t fw_chunk_commit(uint8_t *chunk, physaddr_t dest, uint32_t size);
+
+void fw_chunk_release(uint8_t *chunk);
+#endif
+
+/*
+ * Vectored write: the segments are programmed at consecutive addresses from
+ * dest (which must be word-aligned), without staging them in a contiguous
+ * buffer. Segments may have any address and length, the words crossing a
+ * segment boundary being assembled internally.
+ */
+typedef struct {
+    const void *base;
+    uint32_t    len;
+} fw_iovec_t;
+
+uint8_t fw_storage_writev(physaddr_t dest, const fw_iovec_t *iov, uint32_t iovcnt);
+
 uint8_t fw_storage_finalize_access(void);
 
+/*
+ * SHA256 of the len first bytes of the bank, calculated on the programmed
+ * content while the bank is written, in the same pass as its per-block
+ * CRC32 table (USR_LIB_FIRMWARE_WRITE_HASH). The bank must have been written
+ * sequentially since the bank erase, and the hash must be read before
+ * set_fw_header(). The bytes not written up to len are considered as erased,
+ * the word padding written past len (up to 3 bytes) is not hashed.
+ * This hash checks the programmed content: the hash committed by
+ * set_fw_header() is the one of the source payload, covered by the signature.
+ */
+uint8_t fw_storage_get_hash(uint32_t len, uint8_t hash[SHA256_DIGEST_SIZE]);
+
+/*
+ * Time-sliced writes. Programming and erasing stall the bus: to bound the
+ * latency seen by the other tasks, a buffer write can be split in slices,
+ * the control being returned to the caller between two slices.
+ * Each slice programs up to the slice budget (in bytes and/or in
+ * microseconds, the latter requiring a clock). When the destination is not
+ * erased yet (scheduled erase), the slice only erases the next sector, as a
+ * sector erase can't be split.
+ * The buffer must be kept by the caller until the write is done.
+ */
+typedef struct {
+    uint32_t bytes;                /* max programmed bytes per slice (0: no limit, 4 bytes multiple) */
+    uint32_t usecs;                /* max slice duration (0: no limit) */
+    uint64_t (*clock_us)(void);    /* current time in microseconds */
+} fw_slice_budget_t;
+
+typedef struct {
+    physaddr_t     dest;
+    const uint8_t *buffer;
+    uint32_t       size;
+    uint32_t       done;  /* resume point: already written bytes */
+} fw_write_cursor_t;
+
+uint8_t fw_storage_set_slice_budget(const fw_slice_budget_t *budget);
+
+uint8_t fw_storage_write_start(fw_write_cursor_t *cursor, physaddr_t dest,
+                               uint32_t *buffer, uint32_t size);
+
+uint8_t fw_storage_write_slice(fw_write_cursor_t *cursor);
+
+bool fw_storage_write_done(const fw_write_cursor_t *cursor);
+
+/*
+ * Sparse image writer. The received data runs are written to their extent
+ * destination, the gaps are not programmed (they stay erased).
+ */
+typedef struct {
+    physaddr_t               base;
+    const firmware_extent_t *extents;
+    uint32_t                 count;
+    uint32_t                 current; /* current extent */
+    uint32_t                 offset;  /* offset in the current extent */
+} fw_sparse_writer_t;
+
+uint8_t fw_storage_sparse_init(fw_sparse_writer_t *writer, physaddr_t base,
+                               const firmware_extent_t *extents, uint32_t count);
+
+uint8_t fw_storage_sparse_write(fw_sparse_writer_t *writer, uint32_t *buffer, uint32_t size);
+
+bool fw_storage_sparse_is_complete(const fw_sparse_writer_t *writer);
+
+/*
+ * Hash-tree chunk authentication (FW_TYPE_MERKLE images)
+ *
+ * The payload is split in header->chunksize bytes chunks. Each chunk is a
+ * leaf of a SHA256 binary hash tree:
+ *
+ *   leaf = SHA256(0x00 || index (32 bits, big endian) || chunk)
+ *   node = SHA256(0x01 || left || right)
+ *
+ * A node without sibling (last node of an odd level) is promoted unchanged
+ * to the upper level. The tree root is held by the header hmac field, and is
+ * then authenticated with the header.
+ * Each chunk comes with its authentication path: the sibling hashes from the
+ * leaf level to the root (only for the levels where a sibling exists).
+ * This permits to reject a corrupted chunk before it is programmed.
+ */
+#define FW_CHUNK_HASH_LEN 32
+
+typedef struct {
+    uint8_t  root[FW_CHUNK_HASH_LEN];
+    uint32_t chunksize;
+    uint32_t payload_len;
+    uint32_t nchunks;
+} fw_chunk_auth_t;
+
+/* to be called only once the header has been authenticated */
+uint8_t fw_chunk_auth_init(fw_chunk_auth_t *ctx, const firmware_header_t *header, uint32_t payload_len);
+
+/* return the expected authentication path len (in bytes) of the given chunk */
+uint32_t fw_chunk_auth_path_len(const fw_chunk_auth_t *ctx, uint32_t index);
+
+uint8_t fw_chunk_auth_verify(const fw_chunk_auth_t *ctx, uint32_t index,
+                             const uint8_t *chunk, uint32_t size,
+                             const uint8_t *path, uint32_t pathlen);
+
+/*
+ * verify the chunk, and write it only if it is authentic. The chunk is
+ * written at index * chunksize in the other bank, the address being bound to
+ * the authenticated index.
+ */
+uint8_t fw_storage_write_auth_chunk(const fw_chunk_auth_t *ctx, uint32_t index,
+                                    uint32_t *buffer, uint32_t size,
+                                    const uint8_t *path, uint32_t pathlen);
+
+/*
+ * Encrypted images (FW_TYPE_ENCRYPTED)
+ *
+ * The whole payload (following the header and its signature) is encrypted
+ * with AES in CTR mode. The counter block of the payload byte at offset
+ * 'offset' is iv + offset / 16 (128 bits big endian addition), iv being the
+ * header iv field. Each chunk can then be decrypted independently (and out
+ * of order), in place, given its payload offset.
+ *
+ * Decryption is made by the software AES, or by a hardware hook, called
+ * with the counter block of the first (16 bytes aligned) data block. With a
+ * hardware hook, offsets must be 16 bytes aligned.
+ */
+#define FW_AES_BLOCK_SIZE 16
+#define FW_AES_MAX_ROUNDS 14
+
+typedef struct {
+    uint32_t rounds;
+    uint8_t  rk[(FW_AES_MAX_ROUNDS + 1) * FW_AES_BLOCK_SIZE];
+} fw_aes_ctx_t;
+
+typedef uint8_t (*fw_decrypt_hw_t)(void *hw_ctx, const uint8_t counter[FW_AES_BLOCK_SIZE],
+                                   uint8_t *data, uint32_t len);
+
+typedef struct {
+    uint8_t         iv[FW_IV_LEN];
+    fw_aes_ctx_t    aes;
+    fw_decrypt_hw_t hw;
+    void           *hw_ctx;
+} fw_decrypt_t;
+
+/* software decryption, keylen being 16, 24 or 32 bytes */
+uint8_t fw_decrypt_init(fw_decrypt_t *ctx, const firmware_header_t *header,
+                        const uint8_t *key, uint32_t keylen);
+
+/* hardware decryption, the key being handled by the hardware */
+uint8_t fw_decrypt_init_hw(fw_decrypt_t *ctx, const firmware_header_t *header,
+                           fw_decrypt_hw_t hw, void *hw_ctx);
+
+/* decrypt in place len bytes of payload starting at the given payload offset */
+uint8_t fw_decrypt(const fw_decrypt_t *ctx, uint32_t offset, uint8_t *data, uint32_t len);
+
+/* clear the decryption context (key schedule included) */
+void fw_decrypt_clear(fw_decrypt_t *ctx);
+
+/* decrypt (in place) the buffer, at the given payload offset, and write it to dest */
+uint8_t fw_storage_write_decrypt(const fw_decrypt_t *ctx, uint32_t offset,
+                                 physaddr_t dest, uint32_t *buffer, uint32_t size);
+
+/*
+ * Speculative update
+ *
+ * The bank can be erased and written while the header signature is being
+ * verified, either by another task (the result being given with
+ * fw_sig_verified()) or in time slices by the step function, called by
+ * fw_sig_poll() (e.g. between two chunk writes). The verification is bound
+ * to the header, its signature and the signed hash (the one given to
+ * set_fw_header()). Until they have been successfully verified,
+ * set_fw_header() refuses to commit them. When a step function is given,
+ * set_fw_header() finishes the pending verification.
+ */
+typedef enum {
+    FW_SIG_NONE = 0,    /* no speculative update */
+    FW_SIG_PENDING,
+    FW_SIG_VALID,
+    FW_SIG_INVALID
+} fw_sig_state_t;
+
+/* run the next verification step, returning the verification state */
+typedef fw_sig_state_t (*fw_sig_step_t)(void *ctx);
+
+uint8_t fw_sig_speculate(const firmware_header_t *header, const uint8_t *sig,
+                         const uint8_t *hash, fw_sig_step_t step, void *ctx);
+
+uint8_t fw_sig_verified(const firmware_header_t *header, const uint8_t *sig,
+                        const uint8_t *hash, bool valid);
+
+fw_sig_state_t fw_sig_poll(void);
+
+void fw_sig_cancel(void);
+
 uint8_t set_fw_header(const firmware_header_t *dfu_header, const uint8_t *sig, const uint8_t *hash);
 
 uint8_t clear_other_header(void);
 
+/*
+ * Streaming update
+ *
+ * The whole update sequence is driven by the received bytes, given in
+ * fragments of any size and alignment to fw_update_feed():
+ * - the header is parsed and admitted (see fw_update_admit()), and its
+ *   signature received,
+ * - the other bank header is cleared and the bank erase is scheduled,
+ * - the payload is programmed as it is received (the next sectors being
+ *   erased at each call), along with its digests and its SHA256,
+ * - once the whole payload is received, the signature is verified against
+ *   the header and the payload SHA256 by the verifier given at init time,
+ * - once the signature is verified, the bank header is committed.
+ * The verifier is mandatory: it returns FW_SIG_PENDING until the
+ * verification is done (it is then called again at the next call), then
+ * FW_SIG_VALID or FW_SIG_INVALID. It is run through the speculative update
+ * gate (see fw_sig_speculate()), which is owned by the engine during the
+ * update, and the header is never committed without a valid signature.
+ * Only plain images are handled (no sparse, hash-tree, sector-diff or
+ * encrypted payload). The RAM usage is the context one, whatever the
+ * fragments size: the bytes of a fragment are programmed directly from it,
+ * only the trailing bytes of an incomplete word being kept in the context.
+ * The bank erase and the signature verification progress at each call,
+ * fw_update_feed(ctx, NULL, 0) being usable as an idle tick.
+ */
+typedef enum {
+    FW_UPDATE_HEADER = 0,   /* receiving the header */
+    FW_UPDATE_SIG,          /* receiving the header signature */
+    FW_UPDATE_PAYLOAD,      /* receiving and programming the payload */
+    FW_UPDATE_VERIFY,       /* verifying the signature */
+    FW_UPDATE_DONE,         /* bank header committed */
+    FW_UPDATE_ERROR,
+} fw_update_state_t;
+
+/* verify the signature of the header and payload SHA256 (see above) */
+typedef fw_sig_state_t (*fw_update_verify_t)(void *ctx, const firmware_header_t *header,
+                                             const uint8_t *sig,
+                                             const uint8_t hash[SHA256_DIGEST_SIZE]);
+
+typedef struct {
+    fw_update_state_t state;
+    fw_admit_t        admit;       /* header admission result */
+    firmware_header_t header;
+    uint8_t           sig[EC_MAX_SIGLEN];
+    uint32_t          hdr_received; /* header and signature received bytes */
+    uint32_t          received;     /* payload received bytes */
+    physaddr_t        base;         /* updated bank base address */
+    uint8_t           hash[SHA256_DIGEST_SIZE]; /* received payload SHA256 */
+    fw_update_verify_t verify;
+    void             *verify_ctx;
+    union {
+        uint8_t       raw[sizeof(firmware_header_t)]; /* header being received */
+        uint32_t      tail;         /* payload incomplete word */
+    } stage;
+    sha256_context    sha;
+} fw_update_t;
+
+uint8_t fw_update_init(fw_update_t *ctx, fw_update_verify_t verify, void *verify_ctx);
+
+uint8_t fw_update_feed(fw_update_t *ctx, const uint8_t *data, uint32_t len);
+
+/* return the update state, and the payload progress (if not NULL) */
+fw_update_state_t fw_update_status(const fw_update_t *ctx, uint32_t *done, uint32_t *total);
+
+/* stop the update, the other bank being left not bootable */
+void fw_update_abort(fw_update_t *ctx);
+
+/*
+ * Bank verification, based on the per-block CRC32 table written in the
+ * bank SHR by set_fw_header(). The bank content must be accessible to the
+ * task (e.g. between fw_storage_prepare_access() and
+ * fw_storage_finalize_access() for the updated bank).
+ * On mismatch, bad_block (if not NULL) is set to the index of the first
+ * corrupted block (of FW_DIGEST_BLOCK_SIZE bytes), or to 0xffffffff when
+ * the verification couldn't be executed (no digest table, invalid range...).
+ */
+uint8_t fw_bank_verify_range(partitions_types bank, uint32_t offset, uint32_t len, uint32_t *bad_block);
+
+uint8_t fw_bank_verify(partitions_types bank, uint32_t *bad_block);
+
+/*
+ * Whole bank verification, checking both the per-block CRC32 table and the
+ * header SHA256 in a single pass on the bank content. When all the blocks
+ * are valid but the hash doesn't match, bad_block is set to 0xffffffff.
+ */
+uint8_t fw_bank_verify_hash(partitions_types bank, uint32_t *bad_block);
+
+/*
+ * Background scrub of the running bank. The bank content is checked by
+ * steps of at most max_bytes bytes, e.g. in idle time, the scrub state being
+ * kept in the cursor between two steps. The content is checked against the
+ * per-block CRC32 table of the bank header if any, else against its SHA256.
+ * fw_scrub_step() returns FW_SCRUB_RUNNING until the whole bank is checked.
+ * On failure, bad_block is the index of the first corrupted block (of
+ * FW_DIGEST_BLOCK_SIZE bytes), or 0xffffffff (hash mismatch, invalid header).
+ */
+typedef enum {
+    FW_SCRUB_RUNNING = 0,
+    FW_SCRUB_PASS,
+    FW_SCRUB_FAIL,
+} fw_scrub_state_t;
+
+typedef struct {
+    fw_scrub_state_t state;
+    partitions_types bank;
+    bool             table;     /* per-block CRC32 table, else SHA256 */
+    uint32_t         len;       /* checked len */
+    uint32_t         offset;    /* resume point */
+    uint32_t         crc;       /* current block CRC32 */
+    uint32_t         bad_block;
+    sha256_context   sha;       /* without table only */
+} fw_scrub_t;
+
+uint8_t fw_scrub_start(fw_scrub_t *scrub);
+
+fw_scrub_state_t fw_scrub_step(fw_scrub_t *scrub, uint32_t max_bytes);
+
+/*
+ * Boot bank selection
+ *
+ * Both bootinfo headers are read once and validated (CRC32, bootable flag).
+ * The bootable bank with the highest version is selected (flip if both have
+ * the same version). Returns 0 if a bank is selected, 1 if none is bootable.
+ */
+typedef struct {
+    bool     valid;   /* valid header and bootable */
+    uint32_t type;
+    uint32_t version;
+    uint32_t len;
+    uint8_t  hash[32];
+} fw_bank_info_t;
+
+typedef struct {
+    partitions_types bank;     /* selected bank */
+    fw_bank_info_t   info[2];  /* per bank info, indexed by partitions_types */
+} fw_boot_selection_t;
+
+uint8_t fw_select_boot_bank(fw_boot_selection_t *selection);
+
+/*
+ * Bank clone
+ *
+ * The running bank image (up to its header len) is copied to the other bank,
+ * directly from the running bank storage, and its header (signature
+ * included) is committed in the other bank bootinfo. The running bank header
+ * must be valid, and the other bank header is invalidated first. The other
+ * bank is erased while written, erased runs of the image are not programmed, and the
+ * programmed content is checked as it goes.
+ * The firmware must be position independent to be run from the other bank.
+ */
+uint8_t fw_bank_clone(void);
+
 #endif
@@ -0,0 +1,148 @@
+/* \file fw_admit.c
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+#include "autoconf.h"
+#include "api/libfw.h"
+#include "libc/types.h"
+#include "libc/stdio.h"
+#include "libc/nostd.h"
+#include "libc/string.h"
+#include "fw_storage.h"
+#include "fw_shr.h"
+#include "shr.h"
+
+/*
+ * Update admission: all the checks that don't require the payload are made
+ * on the header, before anything is erased. The running bank bootinfo is
+ * read once, its content being unchanged until the next boot.
+ */
+
+#define FW_TYPE_FLAGS_Msk (FW_TYPE_SPARSE | FW_TYPE_MERKLE | FW_TYPE_SECTOR_DIFF | FW_TYPE_ENCRYPTED)
+
+static struct {
+    bool     cached;
+    uint32_t version;
+} running = { .cached = false };
+
+static uint8_t fw_admit_running_version(uint32_t *version)
+{
+    fw_storage_area_t shr_area;
+    physaddr_t shr;
+    const t_firmware_signature *fw_sig;
+
+    if (running.cached) {
+        *version = running.version;
+        return 0;
+    }
+    if (is_in_flip_mode()) {
+        shr_area = FW_STORAGE_FLIP_SHR;
+        shr = CONFIG_USR_LIB_FIRMWARE_FLIP_BOOTINFO_ADDR;
+    } else if (is_in_flop_mode()) {
+        shr_area = FW_STORAGE_FLOP_SHR;
+        shr = CONFIG_USR_LIB_FIRMWARE_FLOP_BOOTINFO_ADDR;
+    } else {
+        return 1;
+    }
+    if (fw_storage_map(shr_area)) {
+        printf("unable to map shr device\n");
+        return 1;
+    }
+    fw_sig = fw_shr_get_signature(shr, NULL);
+    /* no valid header: consider the current version as the max possible,
+     * as fw_is_rollback() does */
+    running.version = fw_sig ? fw_sig->version : 0xffffffff;
+    if (fw_storage_unmap(shr_area)) {
+        printf("unable to unmap shr device\n");
+        return 1;
+    }
+    running.cached = true;
+    *version = running.version;
+    return 0;
+}
+
+fw_admit_t fw_update_admit(const firmware_header_t *header)
+{
+    uint32_t version;
+
+    if (header == NULL) {
+        return FW_REJECT_HEADER;
+    }
+    if (header->type & ~(FW_TYPE_PARTITION_Msk | FW_TYPE_FLAGS_Msk)) {
+        return FW_REJECT_TYPE;
+    }
+    /* both formats start the payload with their own table */
+    if ((header->type & FW_TYPE_SPARSE) && (header->type & FW_TYPE_SECTOR_DIFF)) {
+        return FW_REJECT_TYPE;
+    }
+    if (is_in_flip_mode()) {
+        if (!firmware_is_partition_flop(header)) {
+            return FW_REJECT_BANK;
+        }
+    } else if (is_in_flop_mode()) {
+        if (!firmware_is_partition_flip(header)) {
+            return FW_REJECT_BANK;
+        }
+    } else {
+        return FW_REJECT_MODE;
+    }
+    if (header->len == 0 || header->len > CONFIG_USR_LIB_FIRMWARE_BANK_SIZE) {
+        return FW_REJECT_LEN;
+    }
+    if (header->siglen == 0 || header->siglen > EC_MAX_SIGLEN) {
+        return FW_REJECT_SIGLEN;
+    }
+    if (fw_admit_running_version(&version)) {
+        return FW_REJECT_BOOTINFO;
+    }
+    /* versions are compared as uint32_t (see fw_version_compare()), equal
+     * versions being a rollback too */
+    if (header->version <= version) {
+        return FW_REJECT_ROLLBACK;
+    }
+    return FW_ADMIT_OK;
+}
+
+const char *fw_admit_reason(fw_admit_t admit)
+{
+    switch (admit) {
+        case FW_ADMIT_OK:
+            return "admitted";
+        case FW_REJECT_HEADER:
+            return "no header";
+        case FW_REJECT_TYPE:
+            return "unsupported image type";
+        case FW_REJECT_MODE:
+            return "neither in flip or flop mode";
+        case FW_REJECT_BANK:
+            return "image not targetting the other bank";
+        case FW_REJECT_LEN:
+            return "invalid image len";
+        case FW_REJECT_SIGLEN:
+            return "invalid signature len";
+        case FW_REJECT_BOOTINFO:
+            return "running bank bootinfo unreadable";
+        case FW_REJECT_ROLLBACK:
+            return "rollback";
+        default:
+            return "unknown";
+    }
+}
@@ -0,0 +1,41 @@
+/* \file fw_aes.h
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+#ifndef FW_AES_H_
+#define FW_AES_H_
+
+#include "libc/types.h"
+#include "api/libfw.h"
+
+/*
+ * Minimal software AES (encryption only, as needed by the CTR mode),
+ * with 128, 192 and 256 bits keys. Compact implementation (no lookup
+ * table except the S-box), targeting code size over speed.
+ * The context (fw_aes_ctx_t) is defined in libfw.h.
+ */
+
+uint8_t fw_aes_setkey(fw_aes_ctx_t *ctx, const uint8_t *key, uint32_t keylen);
+
+void fw_aes_encrypt(const fw_aes_ctx_t *ctx, const uint8_t in[FW_AES_BLOCK_SIZE],
+                    uint8_t out[FW_AES_BLOCK_SIZE]);
+
+#endif/*!FW_AES_H_*/
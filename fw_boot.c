@@ -0,0 +1,102 @@
+/* \file fw_boot.c
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+#include "autoconf.h"
+#include "api/libfw.h"
+#include "libc/types.h"
+#include "libc/stdio.h"
+#include "libc/nostd.h"
+#include "libc/string.h"
+#include "fw_storage.h"
+#include "fw_shr.h"
+#include "shr.h"
+
+/*
+ * Boot bank selection: both SHR are read once, only the written parts of
+ * the headers being actually read. The CRC32 of the erased parts of the SHR
+ * is calculated by crc32_erased(), which doesn't depend on the erased area
+ * size (logarithmic cost), so that the selection costs a few microseconds.
+ */
+
+static void fw_boot_check_bank(physaddr_t shr, fw_bank_info_t *info)
+{
+    const t_firmware_signature *sig;
+    uint32_t bootable = 0;
+
+    memset(info, 0, sizeof(fw_bank_info_t));
+    /* in log mode, the returned record is already checked */
+    sig = fw_shr_get_signature(shr, &bootable);
+    if (sig == NULL || bootable != FW_BOOTABLE) {
+        return;
+    }
+#if !CONFIG_USR_LIB_FIRMWARE_SHR_LOG
+    if (!fw_shr_check_crc((const t_firmware_state*)sig)) {
+        return;
+    }
+#endif
+    info->type = sig->type;
+    info->version = sig->version;
+    info->len = sig->len;
+    memcpy(info->hash, sig->hash, sizeof(info->hash));
+    info->valid = true;
+}
+
+uint8_t fw_select_boot_bank(fw_boot_selection_t *selection)
+{
+    fw_bank_info_t *flip, *flop;
+
+    if (selection == NULL) {
+        return 1;
+    }
+    memset(selection, 0, sizeof(fw_boot_selection_t));
+    flip = &selection->info[PART_FLIP];
+    flop = &selection->info[PART_FLOP];
+
+    if (fw_storage_map(FW_STORAGE_FLIP_SHR)) {
+        printf("unable to map flip-shr device\n");
+        return 1;
+    }
+    if (fw_storage_map(FW_STORAGE_FLOP_SHR)) {
+        printf("unable to map flop-shr device\n");
+        fw_storage_unmap(FW_STORAGE_FLIP_SHR);
+        return 1;
+    }
+    fw_boot_check_bank(CONFIG_USR_LIB_FIRMWARE_FLIP_BOOTINFO_ADDR, flip);
+    fw_boot_check_bank(CONFIG_USR_LIB_FIRMWARE_FLOP_BOOTINFO_ADDR, flop);
+
+    if (fw_storage_unmap(FW_STORAGE_FLOP_SHR) ||
+        fw_storage_unmap(FW_STORAGE_FLIP_SHR)) {
+        printf("unable to unmap shr devices\n");
+        return 1;
+    }
+
+    if (!flip->valid && !flop->valid) {
+        return 1;
+    }
+    /* versions are compared as uint32_t (see fw_version_compare()) */
+    if (!flip->valid || (flop->valid && flop->version > flip->version)) {
+        selection->bank = PART_FLOP;
+    } else {
+        selection->bank = PART_FLIP;
+    }
+    return 0;
+}
@@ -0,0 +1,153 @@
+/* \file fw_chunk_auth.c
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+#include "autoconf.h"
+#include "api/libfw.h"
+#include "libc/types.h"
+#include "libc/stdio.h"
+#include "libc/nostd.h"
+#include "libc/string.h"
+#include "libc/arpa/inet.h"
+#include "libsig.h"
+
+#define LEAF_PREFIX 0x00
+#define NODE_PREFIX 0x01
+
+#if FW_CHUNK_HASH_LEN != SHA256_DIGEST_SIZE
+# error "chunk hash must be a SHA256 digest"
+#endif
+
+uint8_t fw_chunk_auth_init(fw_chunk_auth_t *ctx, const firmware_header_t *header, uint32_t payload_len)
+{
+    if (ctx == NULL || header == NULL) {
+        return 1;
+    }
+    if (!firmware_is_merkle(header) || header->chunksize == 0 || payload_len == 0) {
+        return 1;
+    }
+    memcpy(ctx->root, header->hmac, FW_CHUNK_HASH_LEN);
+    ctx->chunksize = header->chunksize;
+    ctx->payload_len = payload_len;
+    ctx->nchunks = (payload_len / header->chunksize) + ((payload_len % header->chunksize) ? 1 : 0);
+    return 0;
+}
+
+uint32_t fw_chunk_auth_path_len(const fw_chunk_auth_t *ctx, uint32_t index)
+{
+    uint32_t width;
+    uint32_t len = 0;
+
+    if (ctx == NULL || index >= ctx->nchunks) {
+        return 0;
+    }
+    for (width = ctx->nchunks; width > 1; width = (width + 1) / 2) {
+        if ((index ^ 1) < width) {
+            len += FW_CHUNK_HASH_LEN;
+        }
+        index >>= 1;
+    }
+    return len;
+}
+
+uint8_t fw_chunk_auth_verify(const fw_chunk_auth_t *ctx, uint32_t index,
+                             const uint8_t *chunk, uint32_t size,
+                             const uint8_t *path, uint32_t pathlen)
+{
+    sha256_context sha256_ctx;
+    uint8_t  node[SHA256_DIGEST_SIZE];
+    uint8_t  prefix;
+    uint32_t be_index;
+    uint32_t expected_size;
+    uint32_t width;
+
+    if (ctx == NULL || chunk == NULL || index >= ctx->nchunks) {
+        return 1;
+    }
+    /* all chunks are chunksize long, except the last one */
+    expected_size = ctx->payload_len - (index * ctx->chunksize);
+    if (expected_size > ctx->chunksize) {
+        expected_size = ctx->chunksize;
+    }
+    if (size != expected_size || pathlen != fw_chunk_auth_path_len(ctx, index)) {
+        goto err;
+    }
+    if (pathlen && path == NULL) {
+        goto err;
+    }
+
+    /* leaf hash, bound to the chunk index */
+    prefix = LEAF_PREFIX;
+    be_index = htonl(index);
+    sha256_init(&sha256_ctx);
+    sha256_update(&sha256_ctx, &prefix, sizeof(prefix));
+    sha256_update(&sha256_ctx, (const uint8_t*)&be_index, sizeof(be_index));
+    sha256_update(&sha256_ctx, chunk, size);
+    sha256_final(&sha256_ctx, node);
+
+    /* up to the root */
+    prefix = NODE_PREFIX;
+    for (width = ctx->nchunks; width > 1; width = (width + 1) / 2) {
+        if ((index ^ 1) < width) {
+            sha256_init(&sha256_ctx);
+            sha256_update(&sha256_ctx, &prefix, sizeof(prefix));
+            if (index & 1) {
+                sha256_update(&sha256_ctx, path, FW_CHUNK_HASH_LEN);
+                sha256_update(&sha256_ctx, node, SHA256_DIGEST_SIZE);
+            } else {
+                sha256_update(&sha256_ctx, node, SHA256_DIGEST_SIZE);
+                sha256_update(&sha256_ctx, path, FW_CHUNK_HASH_LEN);
+            }
+            sha256_final(&sha256_ctx, node);
+            path += FW_CHUNK_HASH_LEN;
+        }
+        index >>= 1;
+    }
+
+    if (memcmp(node, ctx->root, SHA256_DIGEST_SIZE) != 0) {
+        goto err;
+    }
+    return 0;
+err:
+    return 1;
+}
+
+uint8_t fw_storage_write_auth_chunk(const fw_chunk_auth_t *ctx, uint32_t index,
+                                    uint32_t *buffer, uint32_t size,
+                                    const uint8_t *path, uint32_t pathlen)
+{
+    physaddr_t base;
+
+    if (fw_chunk_auth_verify(ctx, index, (const uint8_t*)buffer, size, path, pathlen)) {
+        printf("chunk %d authentication failed!\n", index);
+        return 1;
+    }
+    /* the chunk is written at its own offset in the other bank only */
+    if (is_in_flip_mode()) {
+        base = CONFIG_USR_LIB_FIRMWARE_FLOP_ADDR;
+    } else if (is_in_flop_mode()) {
+        base = CONFIG_USR_LIB_FIRMWARE_FLIP_ADDR;
+    } else {
+        printf("neither in flip or flop mode !\n");
+        return 1;
+    }
+    return fw_storage_write_buffer(base + (index * ctx->chunksize), buffer, size);
+}
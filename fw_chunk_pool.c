@@ -0,0 +1,122 @@
+/* \file fw_chunk_pool.c
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+#include "autoconf.h"
+#include "api/libfw.h"
+#include "libc/types.h"
+#include "libc/stdio.h"
+#include "libc/nostd.h"
+#include "libc/string.h"
+#include "fw_storage.h"
+
+/*
+ * Chunk buffers pool: the transport layer receives each chunk directly in
+ * a library-owned, word-aligned buffer, which is then programmed in place.
+ * The pool is a fixed static area (no allocation), buffers being loaned and
+ * given back with a bitmap.
+ */
+
+#if CONFIG_USR_LIB_FIRMWARE_CHUNK_POOL
+
+#define FW_CHUNK_NUM  CONFIG_USR_LIB_FIRMWARE_CHUNK_POOL_NUM
+/* buffers are word-aligned: flash is programmed by words */
+#define FW_CHUNK_SIZE ((CONFIG_USR_LIB_FIRMWARE_CHUNK_POOL_SIZE + 3) & ~3)
+
+#if FW_CHUNK_NUM < 1 || FW_CHUNK_NUM > 32
+# error "invalid chunk pool buffers number"
+#endif
+
+static uint32_t chunk_pool[FW_CHUNK_NUM][FW_CHUNK_SIZE / sizeof(uint32_t)];
+/* loaned buffers bitmap */
+static uint32_t chunk_busy = 0;
+/* chunk size of the current image */
+static uint32_t chunk_size = 0;
+
+/* return the pool index of a loaned buffer, or -1 */
+static int fw_chunk_index(const uint8_t *chunk)
+{
+    for (int i = 0; i < FW_CHUNK_NUM; ++i) {
+        if (chunk == (const uint8_t*)chunk_pool[i]) {
+            return (chunk_busy & (1U << i)) ? i : -1;
+        }
+    }
+    return -1;
+}
+
+uint8_t fw_chunk_pool_init(const firmware_header_t *header)
+{
+    if (header == NULL || header->chunksize == 0 ||
+        header->chunksize > FW_CHUNK_SIZE) {
+        printf("chunk size not supported by the pool\n");
+        return 1;
+    }
+    if (chunk_busy) {
+        printf("chunk buffers still loaned\n");
+        return 1;
+    }
+    chunk_size = header->chunksize;
+    return 0;
+}
+
+uint32_t fw_chunk_size(void)
+{
+    return chunk_size;
+}
+
+uint8_t *fw_chunk_acquire(void)
+{
+    if (chunk_size == 0) {
+        return NULL;
+    }
+    for (int i = 0; i < FW_CHUNK_NUM; ++i) {
+        if (!(chunk_busy & (1U << i))) {
+            chunk_busy |= (1U << i);
+            return (uint8_t*)chunk_pool[i];
+        }
+    }
+    return NULL;
+}
+
+void fw_chunk_release(uint8_t *chunk)
+{
+    int i = fw_chunk_index(chunk);
+
+    if (i >= 0) {
+        chunk_busy &= ~(1U << i);
+    }
+}
+
+uint8_t fw_chunk_commit(uint8_t *chunk, physaddr_t dest, uint32_t size)
+{
+    uint8_t ok;
+    int i = fw_chunk_index(chunk);
+
+    if (i < 0 || size > chunk_size) {
+        return 1;
+    }
+    /* programmed in place, the buffer is given back whatever the result */
+    ok = fw_storage_write_buffer(dest, (uint32_t*)chunk, size);
+    chunk_busy &= ~(1U << i);
+    return ok;
+}
+
+#endif
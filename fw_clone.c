@@ -0,0 +1,222 @@
+/* \file fw_clone.c
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+#include "autoconf.h"
+#include "api/libfw.h"
+#include "libc/types.h"
+#include "libc/stdio.h"
+#include "libc/nostd.h"
+#include "libc/string.h"
+#include "fw_storage.h"
+#include "fw_shr.h"
+#include "shr.h"
+
+/*
+ * Bank clone: the running bank content is copied to the other bank directly
+ * from its storage mapping, the other bank being erased (scheduled) while
+ * written. Erased runs of the source are not programmed, the programmed runs
+ * being checked just after being written. The running bank header is then
+ * committed in the other bank bootinfo.
+ */
+
+/* shorter erased runs are programmed along with the surrounding data */
+#define FW_CLONE_SKIP_MIN 64
+
+static inline bool fw_clone_erased(const uint8_t *src)
+{
+    return *(const uint32_t*)src == ERASE_VALUE;
+}
+
+static uint8_t fw_clone_content(physaddr_t dest, const uint8_t *src, uint32_t len)
+{
+    uint32_t off = 0;
+
+    while (off < len) {
+        uint32_t run = 0;
+
+        /* skip the erased words */
+        while (len - off >= 4 && fw_clone_erased(src + off)) {
+            off += 4;
+        }
+        if (off >= len) {
+            break;
+        }
+        /* data run, up to the next erased run long enough to be skipped */
+        for (;;) {
+            uint32_t pos = off + run;
+            uint32_t gap = 0;
+
+            while (gap < FW_CLONE_SKIP_MIN && len - (pos + gap) >= 4 &&
+                   fw_clone_erased(src + pos + gap)) {
+                gap += 4;
+            }
+            if (gap >= FW_CLONE_SKIP_MIN || pos + gap == len) {
+                break;
+            }
+            /* a data word (or the trailing bytes of the image) */
+            run += gap + 4;
+            if (off + run >= len) {
+                run = len - off;
+                break;
+            }
+        }
+        if (fw_storage_write_buffer(dest + off, (uint32_t*)(src + off), run)) {
+            printf("unable to write cloned content at offset %x\n", off);
+            return 1;
+        }
+        if (memcmp(fw_storage_addr(dest + off), src + off, run) != 0) {
+            printf("cloned content mismatch at offset %x\n", off);
+            return 1;
+        }
+        off += run;
+    }
+    return 0;
+}
+
+uint8_t fw_bank_clone(void)
+{
+    firmware_header_t header;
+    uint8_t sig[EC_MAX_SIGLEN];
+    uint8_t hash[SHA256_DIGEST_SIZE];
+    const t_firmware_signature *current;
+    fw_storage_area_t src_area, src_shr_area, dst_shr_area;
+    physaddr_t src_base, src_shr, dst_base, dst_shr;
+    const uint8_t *src;
+    uint32_t bootable = 0;
+    uint8_t ok = 1;
+
+    if (is_in_flip_mode()) {
+        src_area = FW_STORAGE_FLIP;
+        src_shr_area = FW_STORAGE_FLIP_SHR;
+        src_base = CONFIG_USR_LIB_FIRMWARE_FLIP_ADDR;
+        src_shr = CONFIG_USR_LIB_FIRMWARE_FLIP_BOOTINFO_ADDR;
+        dst_shr_area = FW_STORAGE_FLOP_SHR;
+        dst_base = CONFIG_USR_LIB_FIRMWARE_FLOP_ADDR;
+        dst_shr = CONFIG_USR_LIB_FIRMWARE_FLOP_BOOTINFO_ADDR;
+    } else if (is_in_flop_mode()) {
+        src_area = FW_STORAGE_FLOP;
+        src_shr_area = FW_STORAGE_FLOP_SHR;
+        src_base = CONFIG_USR_LIB_FIRMWARE_FLOP_ADDR;
+        src_shr = CONFIG_USR_LIB_FIRMWARE_FLOP_BOOTINFO_ADDR;
+        dst_shr_area = FW_STORAGE_FLIP_SHR;
+        dst_base = CONFIG_USR_LIB_FIRMWARE_FLIP_ADDR;
+        dst_shr = CONFIG_USR_LIB_FIRMWARE_FLIP_BOOTINFO_ADDR;
+    } else {
+        printf("neither in flip or flop mode !\n");
+        return 1;
+    }
+
+    /* the clone replaces any pending speculative update */
+    fw_sig_cancel();
+
+    /* running bank header */
+    if (fw_storage_map(src_shr_area)) {
+        printf("unable to map shr device\n");
+        return 1;
+    }
+    current = fw_shr_get_signature(src_shr, &bootable);
+    if (current == NULL || bootable != FW_BOOTABLE || current->len == 0 ||
+        current->len > CONFIG_USR_LIB_FIRMWARE_BANK_SIZE ||
+        current->siglen > EC_MAX_SIGLEN) {
+        printf("no valid header for the running bank\n");
+        fw_storage_unmap(src_shr_area);
+        return 1;
+    }
+#if !CONFIG_USR_LIB_FIRMWARE_SHR_LOG
+    /* the header is committed again with a new CRC32: a corrupted header
+     * must not be propagated (log records are checked by the lookup) */
+    if (!fw_shr_check_crc((const t_firmware_state*)current)) {
+        printf("running bank header corrupted\n");
+        fw_storage_unmap(src_shr_area);
+        return 1;
+    }
+#endif
+    memset(&header, 0, sizeof(header));
+    header.magic = current->magic;
+    header.type = current->type;
+    header.version = current->version;
+    header.len = current->len;
+    header.siglen = current->siglen;
+    header.chunksize = current->chunksize;
+    memcpy(sig, current->sig, current->siglen);
+    memcpy(hash, current->hash, SHA256_DIGEST_SIZE);
+    if (fw_storage_unmap(src_shr_area)) {
+        printf("unable to unmap shr device\n");
+        return 1;
+    }
+
+    /* the other bank must not be bootable while being written */
+    if (clear_other_header()) {
+        printf("unable to clear the other bank header\n");
+        return 1;
+    }
+
+    /* bank content */
+    if (fw_storage_map(src_area)) {
+        printf("unable to map flash partition device\n");
+        return 1;
+    }
+    src = fw_storage_addr(src_base);
+    if (src == NULL || fw_storage_prepare_access()) {
+        goto err;
+    }
+    if (fw_storage_erase_start() || fw_clone_content(dst_base, src, header.len)) {
+        fw_storage_release_access();
+        goto err;
+    }
+#if CONFIG_USR_LIB_FIRMWARE_WRITE_HASH
+    {
+        uint8_t check[SHA256_DIGEST_SIZE];
+        /* the whole copy is checked against the signed hash */
+        if (fw_storage_get_hash(header.len, check) ||
+            memcmp(check, hash, SHA256_DIGEST_SIZE) != 0) {
+            printf("cloned bank hash mismatch\n");
+            fw_storage_release_access();
+            goto err;
+        }
+    }
+#endif
+    if (fw_storage_finalize_access()) {
+        goto err;
+    }
+    ok = 0;
+
+err:
+    if (fw_storage_unmap(src_area)) {
+        printf("unable to unmap flash partition device\n");
+        return 1;
+    }
+    if (ok) {
+        return ok;
+    }
+
+    /* header commit */
+#if !CONFIG_USR_LIB_FIRMWARE_SHR_LOG
+    if (fw_shr_erase(dst_shr_area, dst_shr)) {
+        return 1;
+    }
+#else
+    (void)dst_shr_area;
+    (void)dst_shr;
+#endif
+    return set_fw_header(&header, sig, hash);
+}
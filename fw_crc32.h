@@ -24,7 +24,6 @@
 #define CRC32_H_
 
 #include "libc/types.h"
-#include "api/libfw.h"
 
 /*
  * @brief Linux-compatible CRC32 implementation
@@ -39,4 +38,27 @@
 
 uint32_t crc32 (const unsigned char *buf, uint32_t len, uint32_t init);
 
+/*
+ * @brief CRC32 of erased (0xff) content
+ *
+ * Equivalent to crc32() on a len bytes buffer filled with 0xff, without
+ * requiring such a buffer.
+ */
+uint32_t crc32_erased(uint32_t len, uint32_t init);
+
+/*
+ * @brief CRC32 register after len null bytes
+ *
+ * crc32(buf, len, init) == crc32_shift(init, len) ^ crc32(buf, len, 0)
+ */
+uint32_t crc32_shift(uint32_t crc, uint32_t len);
+
+/*
+ * @brief CRC32 of the concatenation of two buffers
+ *
+ * crc1 is the CRC32 of the first buffer (from any init value), crc2 the
+ * CRC32 of the second buffer, of len2 bytes, calculated with a 0 init value.
+ */
+uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, uint32_t len2);
+
 #endif/*!CRC32_H_*/
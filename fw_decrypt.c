@@ -0,0 +1,148 @@
+/* \file fw_decrypt.c
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+#include "autoconf.h"
+#include "api/libfw.h"
+#include "libc/types.h"
+#include "libc/stdio.h"
+#include "libc/nostd.h"
+#include "libc/string.h"
+#include "fw_aes.h"
+
+/*
+ * AES-CTR decryption stage of encrypted images: chunks are decrypted in
+ * place, just before being written, the counter being derived from the
+ * header IV and the chunk payload offset.
+ */
+
+static uint8_t fw_decrypt_init_common(fw_decrypt_t *ctx, const firmware_header_t *header)
+{
+    if (ctx == NULL || header == NULL || !firmware_is_encrypted(header)) {
+        return 1;
+    }
+    memset(ctx, 0, sizeof(fw_decrypt_t));
+    memcpy(ctx->iv, header->iv, FW_IV_LEN);
+    return 0;
+}
+
+uint8_t fw_decrypt_init(fw_decrypt_t *ctx, const firmware_header_t *header,
+                        const uint8_t *key, uint32_t keylen)
+{
+    if (fw_decrypt_init_common(ctx, header)) {
+        return 1;
+    }
+    if (fw_aes_setkey(&ctx->aes, key, keylen)) {
+        printf("invalid decryption key\n");
+        return 1;
+    }
+    return 0;
+}
+
+uint8_t fw_decrypt_init_hw(fw_decrypt_t *ctx, const firmware_header_t *header,
+                           fw_decrypt_hw_t hw, void *hw_ctx)
+{
+    if (hw == NULL || fw_decrypt_init_common(ctx, header)) {
+        return 1;
+    }
+    ctx->hw = hw;
+    ctx->hw_ctx = hw_ctx;
+    return 0;
+}
+
+void fw_decrypt_clear(fw_decrypt_t *ctx)
+{
+    if (ctx == NULL) {
+        return;
+    }
+    /* volatile access, so that the key schedule clearing is not optimized out */
+    volatile uint8_t *p = (volatile uint8_t*)ctx;
+    for (uint32_t i = 0; i < sizeof(fw_decrypt_t); ++i) {
+        p[i] = 0;
+    }
+}
+
+/* counter = iv + block (128 bits, big endian) */
+static void fw_decrypt_counter(const uint8_t iv[FW_IV_LEN], uint32_t block,
+                               uint8_t counter[FW_AES_BLOCK_SIZE])
+{
+    uint32_t carry = block;
+
+    for (int i = FW_AES_BLOCK_SIZE - 1; i >= 0; --i) {
+        carry += iv[i];
+        counter[i] = (uint8_t)carry;
+        carry >>= 8;
+    }
+}
+
+static inline void fw_decrypt_counter_inc(uint8_t counter[FW_AES_BLOCK_SIZE])
+{
+    for (int i = FW_AES_BLOCK_SIZE - 1; i >= 0; --i) {
+        if (++counter[i] != 0) {
+            break;
+        }
+    }
+}
+
+uint8_t fw_decrypt(const fw_decrypt_t *ctx, uint32_t offset, uint8_t *data, uint32_t len)
+{
+    uint8_t counter[FW_AES_BLOCK_SIZE];
+    uint8_t stream[FW_AES_BLOCK_SIZE];
+    uint32_t skip = offset % FW_AES_BLOCK_SIZE;
+
+    if (ctx == NULL || (data == NULL && len)) {
+        return 1;
+    }
+    fw_decrypt_counter(ctx->iv, offset / FW_AES_BLOCK_SIZE, counter);
+    if (ctx->hw) {
+        if (skip) {
+            printf("unaligned offset with hardware decryption\n");
+            return 1;
+        }
+        return ctx->hw(ctx->hw_ctx, counter, data, len);
+    }
+    while (len) {
+        uint32_t todo = FW_AES_BLOCK_SIZE - skip;
+        if (todo > len) {
+            todo = len;
+        }
+        fw_aes_encrypt(&ctx->aes, counter, stream);
+        for (uint32_t i = 0; i < todo; ++i) {
+            data[i] ^= stream[skip + i];
+        }
+        fw_decrypt_counter_inc(counter);
+        data += todo;
+        len -= todo;
+        skip = 0;
+    }
+    /* don't leave key stream on the stack */
+    memset(stream, 0, sizeof(stream));
+    return 0;
+}
+
+uint8_t fw_storage_write_decrypt(const fw_decrypt_t *ctx, uint32_t offset,
+                                 physaddr_t dest, uint32_t *buffer, uint32_t size)
+{
+    if (fw_decrypt(ctx, offset, (uint8_t*)buffer, size)) {
+        return 1;
+    }
+    return fw_storage_write_buffer(dest, buffer, size);
+}
@@ -0,0 +1,595 @@
+/* \file fw_digest.c
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+#include "autoconf.h"
+#include "api/libfw.h"
+#include "libc/types.h"
+#include "libc/stdio.h"
+#include "libc/nostd.h"
+#include "libc/string.h"
+#include "fw_crc32.h"
+#include "fw_storage.h"
+#include "fw_digest.h"
+#include "fw_shr.h"
+#include "shr.h"
+
+/*
+ * Block i of a bank covers [i * FW_DIGEST_BLOCK_SIZE, (i + 1) * FW_DIGEST_BLOCK_SIZE[
+ * (truncated to the bank size). Bytes that have not been written are
+ * considered as erased.
+ */
+
+static t_firmware_digests digests;
+/* next expected offset in the bank */
+static uint32_t next_offset = 0;
+static uint32_t current_crc = 0xffffffff;
+static bool     digests_valid = false;
+/* SHA256 of the bank content, calculated along with the table */
+static sha256_context bank_hash;
+static bool     hash_active = false;
+
+/*
+ * The bank hash lags the written content by FW_HASH_LAG bytes, held in
+ * hash_tail: the word padding of the last write is only known to be past
+ * the firmware length when the hash is requested, and must not be hashed.
+ */
+#define FW_HASH_LAG sizeof(uint32_t)
+static uint8_t  hash_tail[FW_HASH_LAG];
+static uint32_t hash_tail_len = 0;
+
+static void bank_hash_update(const uint8_t *data, uint32_t size)
+{
+    uint32_t flush;
+
+    if (size >= FW_HASH_LAG) {
+        sha256_update(&bank_hash, hash_tail, hash_tail_len);
+        sha256_update(&bank_hash, data, size - FW_HASH_LAG);
+        memcpy(hash_tail, data + size - FW_HASH_LAG, FW_HASH_LAG);
+        hash_tail_len = FW_HASH_LAG;
+        return;
+    }
+    /* keep the last FW_HASH_LAG bytes of the tail and data */
+    flush = (hash_tail_len + size > FW_HASH_LAG) ? (hash_tail_len + size - FW_HASH_LAG) : 0;
+    sha256_update(&bank_hash, hash_tail, flush);
+    memmove(hash_tail, hash_tail + flush, hash_tail_len - flush);
+    hash_tail_len -= flush;
+    memcpy(hash_tail + hash_tail_len, data, size);
+    hash_tail_len += size;
+}
+
+/*
+ * Fused CRC32 + SHA256 kernel
+ *
+ * The content is read once, by FW_FUSED_TILE bytes tiles copied on the
+ * stack, both digests being then updated from the tile. On flash, this
+ * halves the wait-stated accesses. The tile is the SHA256 block, so that
+ * aligned updates are never buffered by the SHA256 context.
+ */
+#define FW_FUSED_TILE SHA256_BLOCK_SIZE
+
+/* data set to NULL means erased content, sha set to NULL means the bank hash */
+static void fused_update(uint32_t *crc, sha256_context *sha, const uint8_t *data, uint32_t size)
+{
+    uint32_t tile[FW_FUSED_TILE / sizeof(uint32_t)];
+
+    if (data == NULL) {
+        *crc = crc32_erased(size, *crc);
+        memset(tile, 0xff, sizeof(tile));
+    }
+    while (size) {
+        uint32_t todo = (size < FW_FUSED_TILE) ? size : FW_FUSED_TILE;
+
+        if (data) {
+            memcpy(tile, data, todo);
+            *crc = crc32((const uint8_t*)tile, todo, *crc);
+            data += todo;
+        }
+        if (sha) {
+            sha256_update(sha, (const uint8_t*)tile, todo);
+        } else {
+            bank_hash_update((const uint8_t*)tile, todo);
+        }
+        size -= todo;
+    }
+}
+
+void fw_fused_digest_init(fw_fused_digest_t *ctx)
+{
+    ctx->crc = 0xffffffff;
+    sha256_init(&ctx->sha);
+}
+
+void fw_fused_digest_update(fw_fused_digest_t *ctx, const uint8_t *data, uint32_t size)
+{
+    fused_update(&ctx->crc, &ctx->sha, data, size);
+}
+
+void fw_fused_digest_final(fw_fused_digest_t *ctx, uint32_t *crc, uint8_t hash[SHA256_DIGEST_SIZE])
+{
+    if (crc) {
+        *crc = ctx->crc;
+    }
+    sha256_final(&ctx->sha, hash);
+}
+
+static inline uint32_t block_size(uint32_t block)
+{
+    uint32_t start = block * FW_DIGEST_BLOCK_SIZE;
+
+    if (CONFIG_USR_LIB_FIRMWARE_BANK_SIZE - start < FW_DIGEST_BLOCK_SIZE) {
+        return CONFIG_USR_LIB_FIRMWARE_BANK_SIZE - start;
+    }
+    return FW_DIGEST_BLOCK_SIZE;
+}
+
+/* data set to NULL means erased content */
+static void digest_feed(const uint8_t *data, uint32_t size)
+{
+    while (size) {
+        uint32_t block = next_offset / FW_DIGEST_BLOCK_SIZE;
+        uint32_t room = block_size(block) - (next_offset % FW_DIGEST_BLOCK_SIZE);
+        uint32_t todo = (size < room) ? size : room;
+
+        if (hash_active) {
+            fused_update(&current_crc, NULL, data, todo);
+        } else if (data) {
+            current_crc = crc32(data, todo, current_crc);
+        } else {
+            current_crc = crc32_erased(todo, current_crc);
+        }
+        if (data) {
+            data += todo;
+        }
+        size -= todo;
+        next_offset += todo;
+        if (todo == room) {
+            digests.crc[block] = current_crc;
+            current_crc = 0xffffffff;
+        }
+    }
+}
+
+void fw_digest_reset(void)
+{
+    memset(&digests, 0xff, sizeof(digests));
+    next_offset = 0;
+    current_crc = 0xffffffff;
+    digests_valid = true;
+#if CONFIG_USR_LIB_FIRMWARE_WRITE_HASH
+    sha256_init(&bank_hash);
+    hash_tail_len = 0;
+    hash_active = true;
+#endif
+}
+
+void fw_digest_update(physaddr_t dest, uint32_t size)
+{
+    physaddr_t base;
+    uint32_t offset;
+
+    if (!digests_valid) {
+        return;
+    }
+    if (is_in_flip_mode()) {
+        base = CONFIG_USR_LIB_FIRMWARE_FLOP_ADDR;
+    } else if (is_in_flop_mode()) {
+        base = CONFIG_USR_LIB_FIRMWARE_FLIP_ADDR;
+    } else {
+        digests_valid = false;
+        return;
+    }
+    if (dest < base || dest >= base + CONFIG_USR_LIB_FIRMWARE_BANK_SIZE) {
+        /* not a bank content write (e.g. SHR) */
+        return;
+    }
+    offset = dest - base;
+    if (offset < next_offset ||
+        size > (CONFIG_USR_LIB_FIRMWARE_BANK_SIZE - offset)) {
+        /* rewrite or overflow, the table can't be trusted anymore */
+        digests_valid = false;
+        return;
+    }
+    /* gaps (e.g. sparse images) are left erased */
+    if (offset > next_offset) {
+        digest_feed(NULL, offset - next_offset);
+    }
+    /* calculate the CRC on the programmed content, not on the RAM buffer */
+    digest_feed((const uint8_t*)fw_storage_addr(dest), size);
+}
+
+const t_firmware_digests *fw_digest_get(uint32_t len)
+{
+    uint32_t count;
+
+    if (!digests_valid || len == 0 || len > CONFIG_USR_LIB_FIRMWARE_BANK_SIZE ||
+        next_offset < len) {
+        return NULL;
+    }
+    /* the bank hash covers the len bytes only */
+    hash_active = false;
+    /* finish the current block with the erased content */
+    if (next_offset % FW_DIGEST_BLOCK_SIZE) {
+        uint32_t block = next_offset / FW_DIGEST_BLOCK_SIZE;
+        digest_feed(NULL, block_size(block) - (next_offset % FW_DIGEST_BLOCK_SIZE));
+    }
+    count = (next_offset + FW_DIGEST_BLOCK_SIZE - 1) / FW_DIGEST_BLOCK_SIZE;
+
+    digests.magic = FW_DIGEST_MAGIC;
+    digests.block_size = FW_DIGEST_BLOCK_SIZE;
+    digests.count = count;
+    /* the table is now finalized, a new erase is required to update it */
+    digests_valid = false;
+
+    return &digests;
+}
+
+uint8_t fw_storage_get_hash(uint32_t len, uint8_t hash[SHA256_DIGEST_SIZE])
+{
+#if CONFIG_USR_LIB_FIRMWARE_WRITE_HASH
+    /* only the lagging tail can be past len */
+    if (!digests_valid || !hash_active || len == 0 ||
+        len > CONFIG_USR_LIB_FIRMWARE_BANK_SIZE ||
+        next_offset - hash_tail_len > len) {
+        return 1;
+    }
+    /* the bytes not written up to len are erased */
+    if (next_offset < len) {
+        digest_feed(NULL, len - next_offset);
+    }
+    /* the tail bytes past len are the padding of the last write */
+    sha256_update(&bank_hash, hash_tail, hash_tail_len - (next_offset - len));
+    hash_active = false;
+    sha256_final(&bank_hash, hash);
+    return 0;
+#else
+    (void)len;
+    (void)hash;
+    printf("bank hash not calculated while writing\n");
+    return 1;
+#endif
+}
+
+/*
+ * Bank verification
+ */
+
+static uint8_t fw_bank_verify_blocks(partitions_types bank, uint32_t offset, uint32_t len,
+                                     bool whole, bool hash, uint32_t *bad_block)
+{
+#if CONFIG_USR_LIB_FIRMWARE_SHR_LOG
+    /* log-structured bootinfo records do not hold the digest table */
+    (void)bank;
+    (void)offset;
+    (void)len;
+    (void)whole;
+    (void)hash;
+    if (bad_block) {
+        *bad_block = 0xffffffff;
+    }
+    printf("no digest table with log-structured bootinfo\n");
+    return 1;
+#else
+    uint8_t ok = 1;
+    fw_storage_area_t shr_area;
+    const shr_vars_t *shr_header;
+    physaddr_t bank_addr;
+    const t_firmware_digests *table;
+    uint32_t first, last;
+    uint32_t hash_len = 0;
+    sha256_context sha;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+
+    if (bad_block) {
+        *bad_block = 0xffffffff;
+    }
+    if (bank == PART_FLIP) {
+        shr_header = fw_storage_addr(CONFIG_USR_LIB_FIRMWARE_FLIP_BOOTINFO_ADDR);
+        bank_addr = CONFIG_USR_LIB_FIRMWARE_FLIP_ADDR;
+        shr_area = FW_STORAGE_FLIP_SHR;
+    } else if (bank == PART_FLOP) {
+        shr_header = fw_storage_addr(CONFIG_USR_LIB_FIRMWARE_FLOP_BOOTINFO_ADDR);
+        bank_addr = CONFIG_USR_LIB_FIRMWARE_FLOP_ADDR;
+        shr_area = FW_STORAGE_FLOP_SHR;
+    } else {
+        return 1;
+    }
+    if (!whole && len == 0) {
+        return 1;
+    }
+
+    if (fw_storage_map(shr_area)) {
+        printf("unable to map shr device\n");
+        return 1;
+    }
+
+    table = &(shr_header->fw.digests);
+    if (table->magic != FW_DIGEST_MAGIC ||
+        table->block_size != FW_DIGEST_BLOCK_SIZE ||
+        table->count == 0 || table->count > FW_DIGEST_MAX_BLOCKS) {
+        printf("no digest table in bank header\n");
+        goto err;
+    }
+    if (whole) {
+        first = 0;
+        last = table->count - 1;
+    } else {
+        if (offset > (CONFIG_USR_LIB_FIRMWARE_BANK_SIZE - 1) ||
+            len > (CONFIG_USR_LIB_FIRMWARE_BANK_SIZE - offset)) {
+            goto err;
+        }
+        first = offset / FW_DIGEST_BLOCK_SIZE;
+        last = (offset + len - 1) / FW_DIGEST_BLOCK_SIZE;
+        if (last >= table->count) {
+            goto err;
+        }
+    }
+
+    if (hash) {
+        /* the hash covers the image len, the table its whole blocks */
+        hash_len = shr_header->fw.fw_sig.len;
+        if (hash_len == 0 || hash_len > CONFIG_USR_LIB_FIRMWARE_BANK_SIZE ||
+            hash_len > table->count * FW_DIGEST_BLOCK_SIZE) {
+            printf("invalid image len in bank header\n");
+            goto err;
+        }
+        sha256_init(&sha);
+    }
+
+    /* stop at the first corrupted block */
+    for (uint32_t i = first; i <= last; ++i) {
+        const uint8_t *block = fw_storage_addr(bank_addr + (i * FW_DIGEST_BLOCK_SIZE));
+        uint32_t start = i * FW_DIGEST_BLOCK_SIZE;
+        uint32_t hashed = 0;
+        uint32_t crc = 0xffffffff;
+
+        if (hash && hash_len > start) {
+            hashed = hash_len - start;
+            if (hashed > block_size(i)) {
+                hashed = block_size(i);
+            }
+            fused_update(&crc, &sha, block, hashed);
+        }
+        crc = crc32(block + hashed, block_size(i) - hashed, crc);
+        if (crc != table->crc[i]) {
+#if LIBFW_DEBUG
+            printf("bank block %d corrupted\n", i);
+#endif
+            if (bad_block) {
+                *bad_block = i;
+            }
+            goto err;
+        }
+    }
+    if (hash) {
+        sha256_final(&sha, digest);
+        if (memcmp(digest, shr_header->fw.fw_sig.hash, SHA256_DIGEST_SIZE) != 0) {
+            printf("bank hash mismatch\n");
+            goto err;
+        }
+    }
+    ok = 0;
+
+err:
+    if (fw_storage_unmap(shr_area)) {
+        printf("unable to unmap shr device\n");
+        return 1;
+    }
+    return ok;
+#endif
+}
+
+uint8_t fw_bank_verify_range(partitions_types bank, uint32_t offset, uint32_t len, uint32_t *bad_block)
+{
+    return fw_bank_verify_blocks(bank, offset, len, false, false, bad_block);
+}
+
+uint8_t fw_bank_verify(partitions_types bank, uint32_t *bad_block)
+{
+    return fw_bank_verify_blocks(bank, 0, 0, true, false, bad_block);
+}
+
+uint8_t fw_bank_verify_hash(partitions_types bank, uint32_t *bad_block)
+{
+    return fw_bank_verify_blocks(bank, 0, 0, true, true, bad_block);
+}
+
+/*
+ * Background scrub
+ */
+
+static uint8_t fw_scrub_bank(partitions_types bank, fw_storage_area_t *shr_area,
+                             physaddr_t *shr, physaddr_t *base)
+{
+    if (bank == PART_FLIP) {
+        *shr_area = FW_STORAGE_FLIP_SHR;
+        *shr = CONFIG_USR_LIB_FIRMWARE_FLIP_BOOTINFO_ADDR;
+        *base = CONFIG_USR_LIB_FIRMWARE_FLIP_ADDR;
+    } else if (bank == PART_FLOP) {
+        *shr_area = FW_STORAGE_FLOP_SHR;
+        *shr = CONFIG_USR_LIB_FIRMWARE_FLOP_BOOTINFO_ADDR;
+        *base = CONFIG_USR_LIB_FIRMWARE_FLOP_ADDR;
+    } else {
+        return 1;
+    }
+    return 0;
+}
+
+/* digest table of the (mapped) SHR, or NULL if there is none */
+static const t_firmware_digests *fw_scrub_table(physaddr_t shr)
+{
+#if CONFIG_USR_LIB_FIRMWARE_SHR_LOG
+    (void)shr;
+    return NULL;
+#else
+    const shr_vars_t *shr_vars = fw_storage_addr(shr);
+    const t_firmware_digests *table;
+
+    if (shr_vars == NULL) {
+        return NULL;
+    }
+    table = &(shr_vars->fw.digests);
+    if (table->magic != FW_DIGEST_MAGIC ||
+        table->block_size != FW_DIGEST_BLOCK_SIZE ||
+        table->count == 0 || table->count > FW_DIGEST_MAX_BLOCKS) {
+        return NULL;
+    }
+    return table;
+#endif
+}
+
+uint8_t fw_scrub_start(fw_scrub_t *scrub)
+{
+    fw_storage_area_t shr_area;
+    physaddr_t shr, base;
+    const t_firmware_signature *fw_sig;
+    const t_firmware_digests *table;
+
+    if (scrub == NULL) {
+        return 1;
+    }
+    memset(scrub, 0, sizeof(fw_scrub_t));
+    scrub->state = FW_SCRUB_FAIL;
+    scrub->bad_block = 0xffffffff;
+    if (is_in_flip_mode()) {
+        scrub->bank = PART_FLIP;
+    } else if (is_in_flop_mode()) {
+        scrub->bank = PART_FLOP;
+    } else {
+        printf("neither in flip or flop mode !\n");
+        return 1;
+    }
+    fw_scrub_bank(scrub->bank, &shr_area, &shr, &base);
+
+    if (fw_storage_map(shr_area)) {
+        printf("unable to map shr device\n");
+        return 1;
+    }
+    fw_sig = fw_shr_get_signature(shr, NULL);
+    table = fw_scrub_table(shr);
+    if (table) {
+        /* the table covers whole blocks, up to the bank end */
+        scrub->table = true;
+        scrub->len = table->count * FW_DIGEST_BLOCK_SIZE;
+        if (scrub->len > CONFIG_USR_LIB_FIRMWARE_BANK_SIZE) {
+            scrub->len = CONFIG_USR_LIB_FIRMWARE_BANK_SIZE;
+        }
+    } else if (fw_sig && fw_sig->len && fw_sig->len <= CONFIG_USR_LIB_FIRMWARE_BANK_SIZE) {
+        scrub->len = fw_sig->len;
+        sha256_init(&scrub->sha);
+    }
+    if (fw_storage_unmap(shr_area)) {
+        printf("unable to unmap shr device\n");
+        return 1;
+    }
+    if (scrub->len == 0) {
+        printf("no valid header for the running bank\n");
+        return 1;
+    }
+    scrub->crc = 0xffffffff;
+    scrub->state = FW_SCRUB_RUNNING;
+    return 0;
+}
+
+fw_scrub_state_t fw_scrub_step(fw_scrub_t *scrub, uint32_t max_bytes)
+{
+    fw_storage_area_t shr_area;
+    physaddr_t shr, base;
+    const t_firmware_signature *fw_sig;
+    const t_firmware_digests *table = NULL;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+
+    if (scrub == NULL) {
+        return FW_SCRUB_FAIL;
+    }
+    if (scrub->state != FW_SCRUB_RUNNING) {
+        return scrub->state;
+    }
+    if (fw_scrub_bank(scrub->bank, &shr_area, &shr, &base)) {
+        scrub->state = FW_SCRUB_FAIL;
+        return scrub->state;
+    }
+    if (fw_storage_map(shr_area)) {
+        printf("unable to map shr device\n");
+        /* not a bank failure, retried at next step */
+        return scrub->state;
+    }
+    fw_sig = fw_shr_get_signature(shr, NULL);
+    if (scrub->table) {
+        table = fw_scrub_table(shr);
+    }
+    if (fw_sig == NULL || (scrub->table && table == NULL)) {
+        /* the header has been altered since the scrub start */
+        scrub->state = FW_SCRUB_FAIL;
+        goto end;
+    }
+
+    while (max_bytes && scrub->offset < scrub->len) {
+        const uint8_t *data = fw_storage_addr(base + scrub->offset);
+        uint32_t todo = scrub->len - scrub->offset;
+
+        if (data == NULL) {
+            scrub->state = FW_SCRUB_FAIL;
+            goto end;
+        }
+        if (todo > max_bytes) {
+            todo = max_bytes;
+        }
+        if (table) {
+            uint32_t block = scrub->offset / FW_DIGEST_BLOCK_SIZE;
+            uint32_t room = block_size(block) - (scrub->offset % FW_DIGEST_BLOCK_SIZE);
+
+            if (todo > room) {
+                todo = room;
+            }
+            scrub->crc = crc32(data, todo, scrub->crc);
+            if (todo == room) {
+                if (scrub->crc != table->crc[block]) {
+                    printf("bank block %d corrupted\n", block);
+                    scrub->bad_block = block;
+                    scrub->state = FW_SCRUB_FAIL;
+                    goto end;
+                }
+                scrub->crc = 0xffffffff;
+            }
+        } else {
+            sha256_update(&scrub->sha, data, todo);
+        }
+        scrub->offset += todo;
+        max_bytes -= todo;
+    }
+    if (scrub->offset == scrub->len) {
+        scrub->state = FW_SCRUB_PASS;
+        if (!scrub->table) {
+            sha256_final(&scrub->sha, digest);
+            if (memcmp(digest, fw_sig->hash, SHA256_DIGEST_SIZE) != 0) {
+                printf("bank hash mismatch\n");
+                scrub->state = FW_SCRUB_FAIL;
+            }
+        }
+    }
+
+end:
+    if (fw_storage_unmap(shr_area)) {
+        printf("unable to unmap shr device\n");
+    }
+    return scrub->state;
+}
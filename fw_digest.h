@@ -0,0 +1,43 @@
+/* \file fw_digest.h
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+#ifndef FW_DIGEST_H_
+#define FW_DIGEST_H_
+
+#include "libc/types.h"
+#include "shr.h"
+
+/*
+ * Per-block CRC32 table accumulation. The table is calculated on the
+ * flash content, as it is programmed by fw_storage_write_buffer(), and
+ * written in the SHR by set_fw_header().
+ */
+
+void fw_digest_reset(void);
+
+void fw_digest_update(physaddr_t dest, uint32_t size);
+
+/* return the finalized table, or NULL if the bank has not been written
+ * sequentially since the last bank erase */
+const t_firmware_digests *fw_digest_get(uint32_t len);
+
+#endif/*!FW_DIGEST_H_*/
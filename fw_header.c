@@ -136,7 +136,7 @@ bool firmware_is_partition_flip(__in const firmware_header_t *header)
 	if(header == NULL){
 		goto err;
 	}
-	if(header->type == PART_FLIP){
+	if((header->type & FW_TYPE_PARTITION_Msk) == PART_FLIP){
 		return true;
 	}
 	else{
@@ -152,7 +152,7 @@ bool firmware_is_partition_flop(__in const firmware_header_t *header)
 	if(header == NULL){
 		goto err;
 	}
-	if(header->type == PART_FLOP){
+	if((header->type & FW_TYPE_PARTITION_Msk) == PART_FLOP){
 		return true;
 	}
 	else{
@@ -163,3 +163,131 @@ err:
 	return false;
 }
 
+
+bool firmware_is_sparse(__in const firmware_header_t *header)
+{
+	if(header == NULL){
+		return false;
+	}
+	return (header->type & FW_TYPE_SPARSE) ? true : false;
+}
+
+bool firmware_is_merkle(__in const firmware_header_t *header)
+{
+	if(header == NULL){
+		return false;
+	}
+	return (header->type & FW_TYPE_MERKLE) ? true : false;
+}
+
+bool firmware_is_sector_diff(__in const firmware_header_t *header)
+{
+	if(header == NULL){
+		return false;
+	}
+	return (header->type & FW_TYPE_SECTOR_DIFF) ? true : false;
+}
+
+bool firmware_is_encrypted(__in const firmware_header_t *header)
+{
+	if(header == NULL){
+		return false;
+	}
+	return (header->type & FW_TYPE_ENCRYPTED) ? true : false;
+}
+
+int firmware_parse_sector_manifest(__in  const uint8_t            *buffer,
+                                   __in  const uint32_t            len,
+                                   __in  const firmware_header_t  *header,
+                                   __out firmware_sector_digest_t *digests,
+                                   __in  const uint32_t            max,
+                                   __out uint32_t                 *count)
+{
+	uint32_t num;
+
+	/* Some sanity checks */
+	if((buffer == NULL) || (header == NULL) || (digests == NULL) || (count == NULL)) {
+		goto err;
+	}
+	if(!firmware_is_sector_diff(header)) {
+		goto err;
+	}
+	if(len < sizeof(uint32_t)) {
+		goto err;
+	}
+	memcpy(&num, buffer, sizeof(uint32_t));
+	num = htonl(num);
+	if((num == 0) || (num > max) || (num > FW_SECTOR_DIFF_MAX)) {
+		/* Not enough room to store the digests */
+		goto err;
+	}
+	if(len < FW_SECTOR_MANIFEST_SIZE(num)) {
+		/* The provided buffer is too small! */
+		goto err;
+	}
+	memcpy(digests, buffer + sizeof(uint32_t), num * sizeof(firmware_sector_digest_t));
+	*count = num;
+
+	return 0;
+err:
+	return -1;
+}
+
+int firmware_parse_extents(__in  const uint8_t           *buffer,
+                           __in  const uint32_t           len,
+                           __in  const firmware_header_t *header,
+                           __out firmware_extent_t       *extents,
+                           __in  const uint32_t           max,
+                           __out uint32_t                *count)
+{
+	uint32_t num;
+	uint32_t end = 0;
+
+	/* Some sanity checks */
+	if((buffer == NULL) || (header == NULL) || (extents == NULL) || (count == NULL)) {
+		goto err;
+	}
+	if(!firmware_is_sparse(header)) {
+		goto err;
+	}
+	if(header->len > CONFIG_USR_LIB_FIRMWARE_BANK_SIZE) {
+		goto err;
+	}
+	if(len < sizeof(uint32_t)) {
+		goto err;
+	}
+	memcpy(&num, buffer, sizeof(uint32_t));
+	num = htonl(num);
+	if((num == 0) || (num > max)) {
+		/* Not enough room to store the extents */
+		goto err;
+	}
+	if(len < FW_EXTENT_TABLE_SIZE(num)) {
+		/* The provided buffer is too small! */
+		goto err;
+	}
+
+	memcpy(extents, buffer + sizeof(uint32_t), num * sizeof(firmware_extent_t));
+	for (uint32_t i = 0; i < num; ++i) {
+		extents[i].offset = htonl(extents[i].offset);
+		extents[i].len    = htonl(extents[i].len);
+		/* sorted, non-overlapping, word-aligned extents */
+		if((extents[i].len == 0) || (extents[i].offset < end) ||
+		   (extents[i].offset % 4)) {
+			goto err;
+		}
+		if((extents[i].len % 4) && (i != (num - 1))) {
+			goto err;
+		}
+		if((extents[i].offset > header->len) ||
+		   (extents[i].len > (header->len - extents[i].offset))) {
+			goto err;
+		}
+		end = extents[i].offset + extents[i].len;
+	}
+	*count = num;
+
+	return 0;
+err:
+	return -1;
+}
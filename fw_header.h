@@ -25,9 +25,4 @@
 
 #include "api/libfw.h"
 
-typedef enum {
-	PART_FLIP = 0,
-	PART_FLOP = 1,
-} partitions_types;
-
 #endif
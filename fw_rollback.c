@@ -1,12 +1,12 @@
 #include "autoconf.h"
 #include "libfw.h"
-#include "libflash.h"
 #include "fw_storage.h"
 #include "libc/syscall.h"
 #include "libc/stdio.h"
 #include "libc/nostd.h"
 #include "libc/string.h"
 #include "shr.h"
+#include "fw_shr.h"
 
 
 /*
@@ -58,9 +58,7 @@ int fw_version_compare(uint32_t version1, uint32_t version2)
 
 uint32_t fw_get_current_version(firmware_version_field_t field)
 {
-    uint8_t ret;
-    int desc = 0;
-    t_firmware_state * fw = 0;
+    fw_storage_area_t shr_area;
     uint32_t field_value = 0;
     shr_vars_t *shr_header;
     if (is_in_flip_mode()) {
@@ -74,33 +72,25 @@ uint32_t fw_get_current_version(firmware_version_field_t field)
 #if CONFIG_WOOKEY
     /* mapping device */
     if (is_in_flip_mode()) {
-        desc = flash_get_descriptor(FLIP_SHR);
+        shr_area = FW_STORAGE_FLIP_SHR;
     }
     else if (is_in_flop_mode()) {
-        desc = flash_get_descriptor(FLOP_SHR);
+        shr_area = FW_STORAGE_FLOP_SHR;
     } else {
         goto err;
     }
-    ret = sys_cfg(CFG_DEV_MAP, desc);
-    if (ret != SYS_E_DONE) {
+    if (fw_storage_map(shr_area)) {
         printf("enable to map flash device\n");
         return 0;
     }
 
-    if (is_in_flip_mode()) {
-        fw = &(shr_header->fw);
-    } else if (is_in_flop_mode()) {
-        fw = &(shr_header->fw);
-    } else {
-        goto err;
-    }
-
     /* get back current fw info (read only) - no flash unlock */
-    uint32_t version = fw->fw_sig.version;
+    const t_firmware_signature *fw_sig = fw_shr_get_signature((physaddr_t)shr_header, NULL);
+    /* no valid header: consider the current version as the max possible */
+    uint32_t version = fw_sig ? fw_sig->version : 0xffffffff;
 
     /* unmap device */
-    ret = sys_cfg(CFG_DEV_UNMAP, desc);
-    if (ret != SYS_E_DONE) {
+    if (fw_storage_unmap(shr_area)) {
         printf("enable to map flash device\n");
         return 0;
     }
@@ -0,0 +1,104 @@
+/* \file fw_sector_diff.c
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+#include "autoconf.h"
+#include "api/libfw.h"
+#include "libc/types.h"
+#include "libc/stdio.h"
+#include "libc/nostd.h"
+#include "libc/string.h"
+#include "libsig.h"
+#include "fw_storage.h"
+
+/*
+ * Sector-diff update: the current content of each target sector is hashed
+ * and compared to the manifest digest. Identical sectors are neither erased
+ * nor programmed by the storage layer.
+ */
+
+uint8_t fw_sector_diff_compare(fw_sector_diff_t *diff, physaddr_t base,
+                               const firmware_sector_digest_t *digests, uint32_t count)
+{
+    sha256_context ctx;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    physaddr_t sector = base;
+
+    if (diff == NULL || digests == NULL || count == 0 || count > FW_SECTOR_DIFF_MAX) {
+        return 1;
+    }
+    diff->base = base;
+    diff->count = 0;
+    diff->skipped = 0;
+    memset(diff->identical, 0, sizeof(diff->identical));
+
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t size = fw_storage_sector_size(sector);
+        const uint8_t *content = fw_storage_addr(sector);
+
+        /* the manifest must not go beyond the bank */
+        if (size == 0 || content == NULL ||
+            sector + size > base + CONFIG_USR_LIB_FIRMWARE_BANK_SIZE) {
+            printf("sector manifest doesn't match the bank layout\n");
+            return 1;
+        }
+        sha256_init(&ctx);
+        sha256_update(&ctx, content, size);
+        sha256_final(&ctx, digest);
+        if (memcmp(digest, digests[i].digest, FW_SECTOR_DIGEST_LEN) == 0) {
+            diff->identical[i] = true;
+            diff->skipped++;
+        }
+        sector += size;
+    }
+    diff->count = count;
+#if LIBFW_DEBUG
+    printf("sector-diff: %d/%d identical sectors\n", diff->skipped, count);
+#endif
+    return 0;
+}
+
+bool fw_sector_diff_lookup(const fw_sector_diff_t *diff, physaddr_t addr, physaddr_t *sector_end)
+{
+    physaddr_t sector = diff->base;
+
+    if (addr < sector) {
+        if (sector_end && *sector_end > sector) {
+            *sector_end = sector;
+        }
+        return false;
+    }
+    for (uint32_t i = 0; i < diff->count; ++i) {
+        uint32_t size = fw_storage_sector_size(sector);
+        if (size == 0) {
+            break;
+        }
+        if (addr < sector + size) {
+            if (sector_end && *sector_end > sector + size) {
+                *sector_end = sector + size;
+            }
+            return diff->identical[i];
+        }
+        sector += size;
+    }
+    /* beyond the manifest, the sectors are handled as usual */
+    return false;
+}
@@ -0,0 +1,247 @@
+/* \file fw_shr.c
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+#include "autoconf.h"
+#include "api/libfw.h"
+#include "libc/types.h"
+#include "libc/stdio.h"
+#include "libc/nostd.h"
+#include "libc/string.h"
+#include "fw_storage.h"
+#include "fw_crc32.h"
+#include "fw_shr.h"
+#include "shr.h"
+
+#if CONFIG_USR_LIB_FIRMWARE_SHR_LOG
+
+static inline physaddr_t log_slot_addr(physaddr_t shr, uint32_t slot)
+{
+    return shr + (slot * FW_RECORD_SLOT_SIZE);
+}
+
+static inline const t_firmware_record *log_slot(physaddr_t shr, uint32_t slot)
+{
+    return (const t_firmware_record*)fw_storage_addr(log_slot_addr(shr, slot));
+}
+
+static inline bool log_record_is_valid(const t_firmware_record *rec)
+{
+    if (rec->magic != FW_RECORD_MAGIC) {
+        return false;
+    }
+    return (crc32((const uint8_t*)rec, sizeof(t_firmware_record) - sizeof(uint32_t), 0xffffffff) == rec->crc32);
+}
+
+const t_firmware_record *fw_shr_log_lookup(physaddr_t shr, uint32_t *count)
+{
+    uint32_t low = 0;
+    uint32_t high = FW_RECORD_MAX;
+
+    if (fw_storage_addr(shr) == NULL) {
+        return NULL;
+    }
+    /* used slots are a prefix of the sector: dichotomic search of the first
+     * erased slot */
+    while (low < high) {
+        uint32_t mid = low + ((high - low) / 2);
+        if (log_slot(shr, mid)->magic != ERASE_VALUE) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (count) {
+        *count = low;
+    }
+    /* the newest record may have been partially written (reset during
+     * commit), fallback to the previous valid one */
+    while (low > 0) {
+        low--;
+        if (log_record_is_valid(log_slot(shr, low))) {
+            return log_slot(shr, low);
+        }
+    }
+    return NULL;
+}
+
+#if __GNUC__ > 8
+/*
+ * INFO: Here, we cast a packed struct address in a uint32_t pointer.
+ * This is *not* an error.
+ * Gcc 9 warning is a false positive.
+ */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Waddress-of-packed-member"
+#endif
+uint8_t fw_shr_log_append(physaddr_t shr, const firmware_header_t *header,
+                          const uint8_t *sig, const uint8_t *hash, uint32_t bootable)
+{
+    const t_firmware_record *last;
+    t_firmware_record *rec;
+    t_firmware_sig_fields fields;
+    uint32_t head[2];
+    uint32_t count;
+    uint32_t siglen = 0;
+    uint32_t crc;
+
+    last = fw_shr_log_lookup(shr, &count);
+    if (count >= FW_RECORD_MAX) {
+        /* log is full: this is the only case where the sector is erased */
+        printf("bootinfo log full, erasing sector @%x\n", shr);
+        if (fw_storage_erase_range(shr, SHR_SECTOR_SIZE)) {
+            return 1;
+        }
+        count = 0;
+    }
+    /* storage address of the new record (used for writes only) */
+    rec = (t_firmware_record*)log_slot_addr(shr, count);
+
+    head[0] = FW_RECORD_MAGIC;
+    head[1] = last ? (last->seq + 1) : 0;
+
+    memset(&fields, 0, sizeof(fields));
+    if (header) {
+        if (header->siglen > EC_MAX_SIGLEN || sig == NULL || hash == NULL) {
+            return 1;
+        }
+        fields.magic = header->magic;
+        fields.type = header->type;
+        fields.version = header->version;
+        fields.len = header->len;
+        fields.siglen = header->siglen;
+        fields.chunksize = header->chunksize;
+        siglen = header->siglen;
+    }
+    /* unused in a record, the record has its own CRC32 */
+    fields.crc32 = ERASE_VALUE;
+
+    /* CRC32 of the record as it will be in flash (non-written bytes being erased) */
+    crc = crc32((const uint8_t*)head, sizeof(head), 0xffffffff);
+    crc = crc32((const uint8_t*)&fields, sizeof(fields), crc);
+    if (header) {
+        crc = crc32(hash, SHA256_DIGEST_SIZE, crc);
+        crc = crc32(sig, siglen, crc);
+    } else {
+        crc = crc32_erased(SHA256_DIGEST_SIZE, crc);
+    }
+    crc = crc32_erased(EC_MAX_SIGLEN - siglen, crc);
+    crc = crc32((const uint8_t*)&bootable, sizeof(uint32_t), crc);
+
+    /* magic first, CRC32 last: a partially written record is never valid */
+    fw_storage_write_buffer((physaddr_t)&rec->magic, head, sizeof(head));
+    fw_storage_write_buffer((physaddr_t)&rec->fw_sig, (uint32_t*)&fields, sizeof(fields));
+    if (header) {
+        fw_storage_write_buffer((physaddr_t)rec->fw_sig.hash, (uint32_t*)hash, SHA256_DIGEST_SIZE);
+        fw_storage_write_buffer((physaddr_t)rec->fw_sig.sig, (uint32_t*)sig, siglen);
+    }
+    fw_storage_write_buffer((physaddr_t)&rec->bootable, &bootable, sizeof(uint32_t));
+    fw_storage_write_buffer((physaddr_t)&rec->crc32, &crc, sizeof(uint32_t));
+
+    if (!log_record_is_valid(log_slot(shr, count))) {
+        printf("bootinfo record write failed!\n");
+        return 1;
+    }
+    return 0;
+}
+#if __GNUC__ > 8
+#pragma GCC diagnostic pop
+#endif
+
+#endif
+
+const t_firmware_signature *fw_shr_get_signature(physaddr_t shr, uint32_t *bootable)
+{
+#if CONFIG_USR_LIB_FIRMWARE_SHR_LOG
+    const t_firmware_record *rec = fw_shr_log_lookup(shr, NULL);
+
+    if (rec == NULL) {
+        return NULL;
+    }
+    if (bootable) {
+        *bootable = rec->bootable;
+    }
+    return &rec->fw_sig;
+#else
+    const shr_vars_t *shr_vars = (const shr_vars_t*)fw_storage_addr(shr);
+
+    if (shr_vars == NULL) {
+        return NULL;
+    }
+    if (bootable) {
+        *bootable = shr_vars->fw.bootable;
+    }
+    return &shr_vars->fw.fw_sig;
+#endif
+}
+
+#if !CONFIG_USR_LIB_FIRMWARE_SHR_LOG
+/* check the SHR CRC32, calculated the same way set_fw_header() does */
+bool fw_shr_check_crc(const t_firmware_state *fw)
+{
+    t_firmware_sig_fields fields;
+    uint32_t crc;
+
+    memcpy(&fields, &fw->fw_sig, sizeof(t_firmware_sig_fields));
+    fields.crc32 = ERASE_VALUE;
+
+    crc = crc32((const uint8_t*)&fields, sizeof(t_firmware_sig_fields), 0xffffffff);
+    crc = crc32(fw->fw_sig.hash, SHA256_DIGEST_SIZE, crc);
+    /* the signature is not a part of the CRC32 */
+    crc = crc32_erased(EC_MAX_SIGLEN, crc);
+    /* erased or not, the digest table is covered as is */
+    crc = crc32((const uint8_t*)&fw->digests, sizeof(t_firmware_digests), crc);
+    crc = crc32_erased(sizeof(fw->fill), crc);
+    crc = crc32((const uint8_t*)&fw->bootable, sizeof(uint32_t), crc);
+    crc = crc32_erased(SHR_SECTOR_SIZE - sizeof(uint32_t), crc);
+
+    return (crc == fw->fw_sig.crc32);
+}
+
+uint8_t fw_shr_erase(fw_storage_area_t shr_area, physaddr_t shr)
+{
+    uint8_t ok = 0;
+
+    if (fw_storage_map(FW_STORAGE_CTRL2)) {
+        printf("unable to map flash-ctrl device\n");
+        return 1;
+    }
+    if (fw_storage_map(shr_area)) {
+        printf("unable to map shr device\n");
+        ok = 1;
+        goto err;
+    }
+    if (fw_storage_erase_range(shr, 2 * SHR_SECTOR_SIZE)) {
+        printf("unable to erase bootinfo\n");
+        ok = 1;
+    }
+    if (fw_storage_unmap(shr_area)) {
+        printf("unable to unmap shr device\n");
+        ok = 1;
+    }
+err:
+    if (fw_storage_unmap(FW_STORAGE_CTRL2)) {
+        printf("unable to unmap flash-ctrl device\n");
+        return 1;
+    }
+    return ok;
+}
+#endif
@@ -0,0 +1,74 @@
+/* \file fw_shr.h
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+#ifndef FW_SHR_H_
+#define FW_SHR_H_
+
+#include "autoconf.h"
+#include "api/libfw.h"
+#include "libc/types.h"
+#include "shr.h"
+
+/*
+ * Bootinfo (SHR) layout abstraction. These functions work on an already
+ * mapped SHR, given by its storage address. Returned pointers give a direct
+ * read access to the storage content.
+ */
+
+/*
+ * Return the current signature header of the given SHR, and its bootable
+ * flag (if not NULL), whatever the SHR layout is. Return NULL if there is
+ * no valid header.
+ */
+const t_firmware_signature *fw_shr_get_signature(physaddr_t shr, uint32_t *bootable);
+
+#if !CONFIG_USR_LIB_FIRMWARE_SHR_LOG
+/*
+ * Check the CRC32 of the given (mapped) SHR, calculated the same way
+ * set_fw_header() does. Only the written parts of the SHR are read.
+ */
+bool fw_shr_check_crc(const t_firmware_state *fw);
+
+/*
+ * Erase the given (not mapped) SHR, so that a header can be committed in it
+ * by set_fw_header(). The SHR is mapped, and the flash unlocked, meanwhile.
+ */
+uint8_t fw_shr_erase(fw_storage_area_t shr_area, physaddr_t shr);
+#endif
+
+#if CONFIG_USR_LIB_FIRMWARE_SHR_LOG
+/*
+ * Return the newest valid record of the log, or NULL if none. The number of
+ * used slots is returned in count (if not NULL).
+ */
+const t_firmware_record *fw_shr_log_lookup(physaddr_t shr, uint32_t *count);
+
+/*
+ * Append a record in the log (the flash must be unlocked). When header is
+ * NULL, an invalidation record (cleared fields, not bootable) is appended.
+ * The sector is erased only when the log is full.
+ */
+uint8_t fw_shr_log_append(physaddr_t shr, const firmware_header_t *header,
+                          const uint8_t *sig, const uint8_t *hash, uint32_t bootable);
+#endif
+
+#endif/*!FW_SHR_H_*/
@@ -0,0 +1,142 @@
+/* \file fw_sig_gate.c
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+#include "autoconf.h"
+#include "api/libfw.h"
+#include "libc/types.h"
+#include "libc/stdio.h"
+#include "libc/nostd.h"
+#include "libc/string.h"
+#include "fw_sig_gate.h"
+#include "shr.h"
+
+/*
+ * Speculative update: the bank is erased and written while the header
+ * signature is being verified (by another task, or in time slices through
+ * the step function). The verification result is bound to the header, the
+ * signature and the (signed) hash given at fw_sig_speculate() time, and
+ * set_fw_header() doesn't commit anything (the bank is then never bootable)
+ * until this very header and hash have been successfully verified.
+ */
+
+static struct {
+    fw_sig_state_t    state;
+    firmware_header_t header;
+    uint8_t           sig[EC_MAX_SIGLEN];
+    uint8_t           hash[SHA256_DIGEST_SIZE];
+    fw_sig_step_t     step;
+    void             *ctx;
+} gate = { .state = FW_SIG_NONE };
+
+static bool fw_sig_gate_match(const firmware_header_t *header, const uint8_t *sig,
+                              const uint8_t *hash)
+{
+    if (header == NULL || sig == NULL || hash == NULL) {
+        return false;
+    }
+    return (header->magic == gate.header.magic &&
+            header->type == gate.header.type &&
+            header->version == gate.header.version &&
+            header->len == gate.header.len &&
+            header->siglen == gate.header.siglen &&
+            header->chunksize == gate.header.chunksize &&
+            memcmp(sig, gate.sig, gate.header.siglen) == 0 &&
+            memcmp(hash, gate.hash, SHA256_DIGEST_SIZE) == 0);
+}
+
+uint8_t fw_sig_speculate(const firmware_header_t *header, const uint8_t *sig,
+                         const uint8_t *hash, fw_sig_step_t step, void *ctx)
+{
+    if (header == NULL || sig == NULL || hash == NULL || header->siglen > EC_MAX_SIGLEN) {
+        return 1;
+    }
+    memcpy(&gate.header, header, sizeof(firmware_header_t));
+    memcpy(gate.sig, sig, header->siglen);
+    memcpy(gate.hash, hash, SHA256_DIGEST_SIZE);
+    gate.step = step;
+    gate.ctx = ctx;
+    gate.state = FW_SIG_PENDING;
+    return 0;
+}
+
+uint8_t fw_sig_verified(const firmware_header_t *header, const uint8_t *sig,
+                        const uint8_t *hash, bool valid)
+{
+    if (gate.state != FW_SIG_PENDING || !fw_sig_gate_match(header, sig, hash)) {
+        return 1;
+    }
+    gate.state = valid ? FW_SIG_VALID : FW_SIG_INVALID;
+    return 0;
+}
+
+fw_sig_state_t fw_sig_poll(void)
+{
+    if (gate.state == FW_SIG_PENDING && gate.step != NULL) {
+        fw_sig_state_t state = gate.step(gate.ctx);
+        /* anything else than a success is a failure */
+        if (state != FW_SIG_PENDING) {
+            gate.state = (state == FW_SIG_VALID) ? FW_SIG_VALID : FW_SIG_INVALID;
+        }
+    }
+    return gate.state;
+}
+
+void fw_sig_cancel(void)
+{
+    memset(&gate, 0, sizeof(gate));
+    gate.state = FW_SIG_NONE;
+}
+
+uint8_t fw_sig_gate_check(const firmware_header_t *header, const uint8_t *sig,
+                          const uint8_t *hash, bool required)
+{
+    if (gate.state == FW_SIG_NONE) {
+        if (required) {
+            printf("signature not verified, header not committed\n");
+            return 1;
+        }
+        /* not a speculative update: verified by the caller */
+        return 0;
+    }
+    if (!fw_sig_gate_match(header, sig, hash)) {
+        printf("header doesn't match the speculative update one\n");
+        return 1;
+    }
+    /* finish the verification, if it is driven by the library */
+    while (gate.state == FW_SIG_PENDING && gate.step != NULL) {
+        fw_sig_poll();
+    }
+    if (gate.state == FW_SIG_PENDING) {
+        printf("signature verification pending\n");
+        return 1;
+    }
+    if (gate.state != FW_SIG_VALID) {
+        printf("invalid signature, header not committed\n");
+        return 1;
+    }
+    return 0;
+}
+
+void fw_sig_gate_done(void)
+{
+    fw_sig_cancel();
+}
@@ -0,0 +1,45 @@
+/* \file fw_sig_gate.h
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+#ifndef FW_SIG_GATE_H_
+#define FW_SIG_GATE_H_
+
+#include "autoconf.h"
+#include "api/libfw.h"
+#include "libc/types.h"
+
+/*
+ * Speculative update commit gate, checked by set_fw_header(). Return 0 when
+ * the header can be committed: no speculative update is running (unless
+ * required is set), or its signature has been verified (the pending
+ * verification being finished here when a step function is given) and
+ * matches the committed header, signature and hash.
+ * The library own commit paths set required, so that they never rely on a
+ * verification made by the caller.
+ */
+uint8_t fw_sig_gate_check(const firmware_header_t *header, const uint8_t *sig,
+                          const uint8_t *hash, bool required);
+
+/* the speculative update has been committed */
+void fw_sig_gate_done(void);
+
+#endif/*!FW_SIG_GATE_H_*/
@@ -0,0 +1,95 @@
+/* \file fw_sparse.c
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+#include "autoconf.h"
+#include "api/libfw.h"
+#include "libc/types.h"
+#include "libc/stdio.h"
+#include "libc/nostd.h"
+
+/*
+ * Sparse image writer: the linear payload stream (data runs concatenated)
+ * is dispatched to each extent destination. Only the data runs are
+ * programmed, the gaps stay erased.
+ */
+
+uint8_t fw_storage_sparse_init(fw_sparse_writer_t *writer, physaddr_t base,
+                               const firmware_extent_t *extents, uint32_t count)
+{
+    if (writer == NULL || extents == NULL || count == 0) {
+        return 1;
+    }
+    writer->base = base;
+    writer->extents = extents;
+    writer->count = count;
+    writer->current = 0;
+    writer->offset = 0;
+    return 0;
+}
+
+/*
+ * As for fw_storage_write_buffer(), size is in bytes and should be a 4 bytes
+ * multiple (except for the last chunk). As extents are word-aligned, each
+ * piece of the buffer stays word-aligned.
+ */
+uint8_t fw_storage_sparse_write(fw_sparse_writer_t *writer, uint32_t *buffer, uint32_t size)
+{
+    uint8_t *data = (uint8_t*)buffer;
+
+    if (writer == NULL || buffer == NULL) {
+        return 1;
+    }
+    while (size) {
+        const firmware_extent_t *ext;
+        uint32_t towrite;
+
+        if (writer->current >= writer->count) {
+            printf("sparse: data beyond the last extent!\n");
+            return 1;
+        }
+        ext = &writer->extents[writer->current];
+        towrite = ext->len - writer->offset;
+        if (towrite > size) {
+            towrite = size;
+        }
+        if (fw_storage_write_buffer(writer->base + ext->offset + writer->offset,
+                                    (uint32_t*)data, towrite)) {
+            return 1;
+        }
+        data += towrite;
+        size -= towrite;
+        writer->offset += towrite;
+        if (writer->offset == ext->len) {
+            writer->current++;
+            writer->offset = 0;
+        }
+    }
+    return 0;
+}
+
+bool fw_storage_sparse_is_complete(const fw_sparse_writer_t *writer)
+{
+    if (writer == NULL) {
+        return false;
+    }
+    return (writer->current == writer->count);
+}
@@ -3,304 +3,680 @@
 #include "libc/types.h"
 #include "libc/stdio.h"
 #include "libc/nostd.h"
-#include "libflash.h"
+#include "libc/string.h"
 #include "fw_storage.h"
-#include "libc/syscall.h"
+#include "fw_digest.h"
+#include "shr.h"
 
 #define FW_STORAGE_DEBUG 0
 
-uint8_t fw_storage_early_init(t_device_mapping *devmap)
+#if CONFIG_USR_DRV_FLASH
+static const fw_storage_ops_t *storage_ops = &fw_storage_flash_ops;
+#else
+static const fw_storage_ops_t *storage_ops = NULL;
+#endif
+
+/* scheduled bank erase: [cursor, end[ is still to be erased */
+typedef struct {
+    bool       active;
+    bool       pending;  /* the sector at cursor is being erased */
+    physaddr_t cursor;
+    physaddr_t end;
+} fw_erase_sched_t;
+
+static fw_erase_sched_t erase_sched = { false, false, 0, 0 };
+
+/* current sector-diff update, if any */
+static const fw_sector_diff_t *storage_diff = NULL;
+
+/* time-sliced writes budget (no limit by default) */
+static fw_slice_budget_t slice_budget = { 0, 0, NULL };
+
+/* programming step when the slice is bounded in time */
+#define FW_SLICE_STEP 256
+
+/*
+ * Firmware layout, from the Kconfig values. Each mode may only erase and
+ * program the other bank and its bootinfo sectors, whatever the storage
+ * backend. The layout is checked at build time, the writable areas being
+ * constant tables.
+ */
+#define FW_BANK_SIZE     CONFIG_USR_LIB_FIRMWARE_BANK_SIZE
+#define FW_BOOTINFO_SIZE (2 * SHR_SECTOR_SIZE)
+
+#define FW_OVERLAP(a, alen, b, blen) (((a) < (b) + (blen)) && ((b) < (a) + (alen)))
+
+#if FW_OVERLAP(CONFIG_USR_LIB_FIRMWARE_FLIP_ADDR, FW_BANK_SIZE, CONFIG_USR_LIB_FIRMWARE_FLOP_ADDR, FW_BANK_SIZE) || \
+    FW_OVERLAP(CONFIG_USR_LIB_FIRMWARE_FLIP_ADDR, FW_BANK_SIZE, CONFIG_USR_LIB_FIRMWARE_FLOP_BOOTINFO_ADDR, FW_BOOTINFO_SIZE) || \
+    FW_OVERLAP(CONFIG_USR_LIB_FIRMWARE_FLIP_BOOTINFO_ADDR, FW_BOOTINFO_SIZE, CONFIG_USR_LIB_FIRMWARE_FLOP_ADDR, FW_BANK_SIZE) || \
+    FW_OVERLAP(CONFIG_USR_LIB_FIRMWARE_FLIP_BOOTINFO_ADDR, FW_BOOTINFO_SIZE, CONFIG_USR_LIB_FIRMWARE_FLOP_BOOTINFO_ADDR, FW_BOOTINFO_SIZE)
+# error "flip and flop firmware areas overlap"
+#endif
+#if FW_OVERLAP(CONFIG_USR_LIB_FIRMWARE_FLIP_ADDR, FW_BANK_SIZE, CONFIG_USR_LIB_FIRMWARE_FLIP_BOOTINFO_ADDR, FW_BOOTINFO_SIZE) || \
+    FW_OVERLAP(CONFIG_USR_LIB_FIRMWARE_FLOP_ADDR, FW_BANK_SIZE, CONFIG_USR_LIB_FIRMWARE_FLOP_BOOTINFO_ADDR, FW_BOOTINFO_SIZE)
+# error "firmware bank and bootinfo areas overlap"
+#endif
+
+typedef struct {
+    physaddr_t start;
+    physaddr_t end;
+} fw_range_t;
+
+#define FW_AREAS_NUM 2
+
+/* writable areas, indexed by the updated (i.e. the other) bank */
+static const fw_range_t fw_writable[2][FW_AREAS_NUM] = {
+    [PART_FLIP] = {
+        { CONFIG_USR_LIB_FIRMWARE_FLIP_ADDR,
+          CONFIG_USR_LIB_FIRMWARE_FLIP_ADDR + FW_BANK_SIZE },
+        { CONFIG_USR_LIB_FIRMWARE_FLIP_BOOTINFO_ADDR,
+          CONFIG_USR_LIB_FIRMWARE_FLIP_BOOTINFO_ADDR + FW_BOOTINFO_SIZE },
+    },
+    [PART_FLOP] = {
+        { CONFIG_USR_LIB_FIRMWARE_FLOP_ADDR,
+          CONFIG_USR_LIB_FIRMWARE_FLOP_ADDR + FW_BANK_SIZE },
+        { CONFIG_USR_LIB_FIRMWARE_FLOP_BOOTINFO_ADDR,
+          CONFIG_USR_LIB_FIRMWARE_FLOP_BOOTINFO_ADDR + FW_BOOTINFO_SIZE },
+    },
+};
+
+bool fw_storage_is_writable(physaddr_t addr, uint32_t size)
 {
-    int ret = 0;
+    const fw_range_t *areas;
 
-    if (devmap) {
-        ret = flash_device_early_init(devmap);
+    if (is_in_flip_mode()) {
+        areas = fw_writable[PART_FLOP];
+    } else if (is_in_flop_mode()) {
+        areas = fw_writable[PART_FLIP];
     } else {
-        printf("unable to declare flash!\n");
-        ret = 1;
+        printf("neither in flip or flop mode !\n");
+        return false;
     }
-    if (ret != 0) {
-        goto err;
+    for (uint32_t i = 0; i < FW_AREAS_NUM; ++i) {
+        if (addr >= areas[i].start && addr < areas[i].end &&
+            size <= areas[i].end - addr) {
+            return true;
+        }
     }
+    return false;
+}
+
+uint8_t fw_storage_set_backend(const fw_storage_ops_t *ops)
+{
+    if (ops == NULL || ops->map == NULL || ops->unmap == NULL ||
+        ops->release == NULL || ops->erase_range == NULL ||
+        ops->sector_size == NULL || ops->program == NULL || ops->read == NULL || ops->addr == NULL ||
+        ((ops->erase_begin == NULL) != (ops->erase_busy == NULL))) {
+        printf("invalid storage backend\n");
+        return 1;
+    }
+    storage_ops = ops;
     return 0;
+}
 
-err:
-    return 1;
+uint8_t fw_storage_early_init(t_device_mapping *devmap)
+{
+#if CONFIG_USR_DRV_FLASH
+    if (storage_ops == &fw_storage_flash_ops) {
+        return fw_storage_flash_early_init(devmap);
+    }
+#else
+    (void)devmap;
+#endif
+    return 0;
 }
 
 
 uint8_t fw_storage_init(void)
 {
-
+    if (storage_ops == NULL) {
+        printf("no storage backend!\n");
+        return 1;
+    }
     return 0;
 }
 
-/* This function erase the other firmware (i.e. flip if in flop, flop if in
- * flip) flash sectors. The bootloader & SHR sectors are *not* erased
- * The code bellow is implemented for 2MB flash size. */
-uint8_t fw_storage_erase_bank(void)
-{
-    uint8_t ret;
-    int desc;
+/*
+ * Backend accessors
+ */
 
-    /* mapping flash-ctrl */
-    desc = flash_get_descriptor(CTRL);
-    ret = sys_cfg(CFG_DEV_MAP, desc);
-    if (ret != SYS_E_DONE) {
-        printf("unable to map flash-ctrl device\n");
+uint8_t fw_storage_map(fw_storage_area_t area)
+{
+    if (storage_ops == NULL) {
         return 1;
     }
-
-    /* unlocking flash */
-    flash_unlock();
-
-    if (is_in_flip_mode()) {
-        /* erasing flop sectors */
-# if (CONFIG_USR_DRV_FLASH_1M && CONFIG_USR_DRV_FLASH_DUAL_BANK) || CONFIG_USR_DRV_FLASH_2M
-        flash_sector_erase(FLASH_SECTOR_17);
-        flash_sector_erase(FLASH_SECTOR_18);
-        flash_sector_erase(FLASH_SECTOR_19);
+#if FW_STORAGE_DEBUG
+    printf("mapping storage area %d\n", area);
 #endif
-# if CONFIG_USR_DRV_FLASH_2M
-        flash_sector_erase(FLASH_SECTOR_20);
-        flash_sector_erase(FLASH_SECTOR_21);
-        flash_sector_erase(FLASH_SECTOR_22);
-        flash_sector_erase(FLASH_SECTOR_23);
+    return storage_ops->map(area);
+}
+
+uint8_t fw_storage_unmap(fw_storage_area_t area)
+{
+    if (storage_ops == NULL) {
+        return 1;
+    }
+#if FW_STORAGE_DEBUG
+    printf("unmapping storage area %d\n", area);
 #endif
+    return storage_ops->unmap(area);
+}
+
+uint8_t fw_storage_release(fw_storage_area_t area)
+{
+    if (storage_ops == NULL) {
+        return 1;
     }
-    if (is_in_flop_mode()) {
-        /* erasing flop sectors */
-        flash_sector_erase(FLASH_SECTOR_5);
-        flash_sector_erase(FLASH_SECTOR_6);
-        flash_sector_erase(FLASH_SECTOR_7);
-# if (CONFIG_USR_DRV_FLASH_1M && !CONFIG_USR_DRV_FLASH_DUAL_BANK) || CONFIG_USR_DRV_FLASH_2M
-        flash_sector_erase(FLASH_SECTOR_8);
-        flash_sector_erase(FLASH_SECTOR_9);
-        flash_sector_erase(FLASH_SECTOR_10);
-        flash_sector_erase(FLASH_SECTOR_11);
+#if FW_STORAGE_DEBUG
+    printf("releasing storage area %d\n", area);
 #endif
+    return storage_ops->release(area);
+}
+
+/*
+ * Whole sectors overlapping [addr, addr + len[ are erased: they must all be
+ * writable. Backend sectors are aligned on their size.
+ */
+static bool fw_storage_erase_is_writable(physaddr_t addr, uint32_t len)
+{
+    physaddr_t end = addr + len;
+    uint32_t first_size, last_size;
+    physaddr_t first, last;
+
+    if (len == 0 || end < addr) {
+        return false;
     }
+    first_size = storage_ops->sector_size(addr);
+    last_size = storage_ops->sector_size(end - 1);
+    if (first_size == 0 || last_size == 0) {
+        return false;
+    }
+    first = addr - (addr % first_size);
+    last = (end - 1) - ((end - 1) % last_size);
+    return fw_storage_is_writable(first, (last + last_size) - first);
+}
 
-    /* lock flash CR */
-    flash_lock();
-    /* unmap flash-ctrl */
-    ret = sys_cfg(CFG_DEV_UNMAP, desc);
-    if (ret != SYS_E_DONE) {
-        printf("unable to unmap flash-ctrl device\n");
+uint8_t fw_storage_erase_range(physaddr_t addr, uint32_t len)
+{
+    if (storage_ops == NULL) {
         return 1;
     }
-
-    return 0;
+    if (!fw_storage_erase_is_writable(addr, len)) {
+        printf("erased sectors not in the other bank !!!\n");
+        return 1;
+    }
+    return storage_ops->erase_range(addr, len);
 }
 
-uint8_t fw_storage_prepare_access(void)
+/* start erasing the sector at addr, without waiting for its completion */
+static uint8_t fw_storage_erase_begin(physaddr_t addr, uint32_t size)
 {
+    if (!fw_storage_erase_is_writable(addr, size)) {
+        printf("erased sectors not in the other bank !!!\n");
+        return 1;
+    }
+    return storage_ops->erase_begin(addr);
+}
 
-    uint8_t ret;
-    int desc;
-    uint8_t  desc_id = 0;
+uint32_t fw_storage_sector_size(physaddr_t addr)
+{
+    if (storage_ops == NULL) {
+        return 0;
+    }
+    return storage_ops->sector_size(addr);
+}
 
-    /* mapping flash-ctrl */
-    desc = flash_get_descriptor(CTRL);
+uint8_t fw_storage_program(physaddr_t dest, const uint8_t *src, uint32_t size)
+{
+    if (storage_ops == NULL) {
+        return 1;
+    }
+    if (!fw_storage_is_writable(dest, size)) {
+        printf("destination not in the other bank !!!\n");
+        return 1;
+    }
+    return storage_ops->program(dest, src, size);
+}
 
-#if FW_STORAGE_DEBUG
-    printf("mapping flash-ctrl (desc: %d)\n", desc);
-#endif
-    ret = sys_cfg(CFG_DEV_MAP, desc);
-    if (ret != SYS_E_DONE) {
-        printf("unable to map flash-ctrl device\n");
+uint8_t fw_storage_read(physaddr_t src, uint8_t *dest, uint32_t size)
+{
+    if (storage_ops == NULL || dest == NULL) {
         return 1;
     }
+    return storage_ops->read(src, dest, size);
+}
 
-    if (is_in_flip_mode()) {
-        desc_id = FLOP;
+const void *fw_storage_addr(physaddr_t addr)
+{
+    if (storage_ops == NULL) {
+        return NULL;
+    }
+    return storage_ops->addr(addr);
+}
+
+/*
+ * Bank access
+ */
 
+/* return the other (i.e. to be updated) bank */
+static uint8_t fw_storage_other_bank(fw_storage_area_t *area, physaddr_t *base)
+{
+    if (is_in_flip_mode()) {
+        *area = FW_STORAGE_FLOP;
+        *base = CONFIG_USR_LIB_FIRMWARE_FLOP_ADDR;
     } else if (is_in_flop_mode()) {
-        desc_id = FLIP;
+        *area = FW_STORAGE_FLIP;
+        *base = CONFIG_USR_LIB_FIRMWARE_FLIP_ADDR;
     } else {
         printf("neither in flip or flop mode !\n");
         return 1;
     }
-    /* mounting flash memory area */
-    desc = flash_get_descriptor(desc_id);
-#if FW_STORAGE_DEBUG
-    printf("mapping flash partition (desc: %d)\n", desc);
-#endif
+    return 0;
+}
 
-    ret = sys_cfg(CFG_DEV_MAP, desc);
-    if (ret != SYS_E_DONE) {
-        printf("unable to map flash partition device\n");
+/*
+ * Bank erase scheduler
+ */
+
+/* wait for the end of the started sector erase, if any */
+static void fw_storage_erase_wait(void)
+{
+    while (erase_sched.pending && storage_ops->erase_busy()) {
+        continue;
+    }
+    erase_sched.pending = false;
+}
+
+uint8_t fw_storage_erase_start(void)
+{
+    fw_storage_area_t area;
+    physaddr_t base;
+
+    if (fw_storage_other_bank(&area, &base)) {
         return 1;
     }
+    /* a new bank content is coming, restart the digest table */
+    fw_digest_reset();
+
+    storage_diff = NULL;
+    fw_storage_erase_wait();
+    erase_sched.cursor = base;
+    erase_sched.end = base + CONFIG_USR_LIB_FIRMWARE_BANK_SIZE;
+    erase_sched.active = true;
+    return 0;
+}
 
-    /* unlocking flash */
-    flash_unlock();
+/*
+ * When the backend can start a sector erase without waiting for it, a poll
+ * completes the sector started by the previous poll (returning at once if it
+ * is still being erased) and starts the next one. Otherwise, each sector
+ * erase blocks until it is done.
+ */
+uint8_t fw_storage_erase_poll(uint32_t max_sectors)
+{
+    while (erase_sched.active && max_sectors) {
+        uint32_t size = fw_storage_sector_size(erase_sched.cursor);
+        if (size == 0) {
+            erase_sched.active = false;
+            return 1;
+        }
+        if (erase_sched.pending) {
+            if (storage_ops->erase_busy()) {
+                return 0;
+            }
+            erase_sched.pending = false;
+        } else {
+            --max_sectors;
+            /* identical sectors of a sector-diff update are kept */
+            if (storage_diff && fw_sector_diff_lookup(storage_diff, erase_sched.cursor, NULL)) {
+#if FW_STORAGE_DEBUG
+                printf("keeping identical sector @%x\n", erase_sched.cursor);
+#endif
+            } else if (storage_ops->erase_begin) {
+                if (fw_storage_erase_begin(erase_sched.cursor, size)) {
+                    printf("unable to erase sector @%x\n", erase_sched.cursor);
+                    erase_sched.active = false;
+                    return 1;
+                }
+                erase_sched.pending = true;
+                continue;
+            } else if (fw_storage_erase_range(erase_sched.cursor, size)) {
+                printf("unable to erase sector @%x\n", erase_sched.cursor);
+                erase_sched.active = false;
+                return 1;
+            }
+        }
+        erase_sched.cursor += size;
+        if (erase_sched.cursor >= erase_sched.end) {
+            erase_sched.active = false;
+        }
+    }
     return 0;
 }
 
-uint8_t fw_storage_release_access(void)
+bool fw_storage_erase_done(void)
 {
-    uint8_t ret;
-    int desc;
-    uint8_t  desc_id = 0;
+    return !erase_sched.active;
+}
 
-    /* unmapping FLIP or FLOP */
-    if (is_in_flip_mode()) {
-        desc_id = FLOP;
+/* erase the scheduled sectors up to (at least) the given address */
+static uint8_t fw_storage_erase_until(physaddr_t addr)
+{
+    while (erase_sched.active && erase_sched.cursor < addr) {
+        if (fw_storage_erase_poll(1)) {
+            return 1;
+        }
+    }
+    return 0;
+}
 
-    } else if (is_in_flop_mode()) {
-        desc_id = FLIP;
-    } else {
-        printf("neither in flip or flop mode !\n");
+uint8_t fw_storage_diff_start(fw_sector_diff_t *diff,
+                              const firmware_sector_digest_t *digests, uint32_t count)
+{
+    fw_storage_area_t area;
+    physaddr_t base;
+
+    if (fw_storage_other_bank(&area, &base)) {
+        return 1;
+    }
+    /* the current content is compared before any erase */
+    if (fw_sector_diff_compare(diff, base, digests, count)) {
+        return 1;
+    }
+    if (fw_storage_erase_start()) {
         return 1;
     }
+    storage_diff = diff;
+    return 0;
+}
 
-    desc = flash_get_descriptor(desc_id);
-#if FW_STORAGE_DEBUG
-    printf("unmapping flash partition (desc: %d)\n", desc);
-#endif
+/* This function erase the other firmware (i.e. flip if in flop, flop if in
+ * flip) flash sectors. The bootloader & SHR sectors are *not* erased */
+uint8_t fw_storage_erase_bank(void)
+{
+    uint8_t ok = 0;
 
-    ret = sys_cfg(CFG_DEV_UNMAP, desc);
-    if (ret != SYS_E_DONE) {
-        printf("unable to unmap flash partition device\n");
+    /* mapping (and unlocking) storage ctrl */
+    if (fw_storage_map(FW_STORAGE_CTRL)) {
+        printf("unable to map flash-ctrl device\n");
         return 1;
     }
 
-    /* unmapping flash-ctrl */
-    desc = flash_get_descriptor(CTRL);
-
-    /* lock flash CR */
-    flash_lock();
+    if (fw_storage_erase_start() ||
+        fw_storage_erase_until(erase_sched.end)) {
+        printf("unable to erase bank\n");
+        ok = 1;
+    }
 
-#if FW_STORAGE_DEBUG
-    printf("Unmapping flash-ctrl (desc: %d)\n", desc);
-#endif
-    ret = sys_cfg(CFG_DEV_UNMAP, desc);
-    if (ret != SYS_E_DONE) {
+    /* lock and unmap storage ctrl */
+    if (fw_storage_unmap(FW_STORAGE_CTRL)) {
         printf("unable to unmap flash-ctrl device\n");
         return 1;
     }
 
-    return 0;
+    return ok;
 }
 
-uint8_t fw_storage_finalize_access(void)
+uint8_t fw_storage_prepare_access(void)
 {
-    uint8_t ret;
-    int desc = 0;
-    uint8_t  desc_id = 0;
+    fw_storage_area_t area;
+    physaddr_t base;
 
-    if (is_in_flip_mode()) {
-        desc_id = FLOP;
+    if (fw_storage_other_bank(&area, &base)) {
+        return 1;
+    }
+    /* mapping (and unlocking) storage ctrl */
+    if (fw_storage_map(FW_STORAGE_CTRL)) {
+        printf("unable to map flash-ctrl device\n");
+        return 1;
+    }
+    /* mounting flash memory area */
+    if (fw_storage_map(area)) {
+        printf("unable to map flash partition device\n");
+        return 1;
+    }
+    return 0;
+}
 
-    } else if (is_in_flop_mode()) {
-        desc_id = FLIP;
-    } else {
-        printf("neither in flip or flop mode !\n");
+uint8_t fw_storage_release_access(void)
+{
+    fw_storage_area_t area;
+    physaddr_t base;
+
+    /* unmapping FLIP or FLOP */
+    if (fw_storage_other_bank(&area, &base)) {
+        return 1;
+    }
+    /* access aborted, the scheduled erase (if any) is cancelled, the started
+     * sector erase being completed */
+    fw_storage_erase_wait();
+    erase_sched.active = false;
+    storage_diff = NULL;
+    if (fw_storage_unmap(area)) {
+        printf("unable to unmap flash partition device\n");
+        return 1;
+    }
+    /* lock and unmap storage ctrl */
+    if (fw_storage_unmap(FW_STORAGE_CTRL)) {
+        printf("unable to unmap flash-ctrl device\n");
         return 1;
     }
+    return 0;
+}
 
-    desc = flash_get_descriptor(desc_id);
-#if FW_STORAGE_DEBUG
-    printf("unmapping flash-area (desc: %d)\n", desc);
-#endif
+uint8_t fw_storage_finalize_access(void)
+{
+    fw_storage_area_t area;
+    physaddr_t base;
 
-    ret = sys_cfg(CFG_DEV_UNMAP, desc);
-    if (ret != SYS_E_DONE) {
+    if (fw_storage_other_bank(&area, &base)) {
+        return 1;
+    }
+    /* finish the scheduled erase, the whole bank must be erased */
+    if (fw_storage_erase_until(erase_sched.end)) {
+        return 1;
+    }
+    storage_diff = NULL;
+    if (fw_storage_unmap(area)) {
         printf("unable to unmap flash memory device\n");
         return 1;
     }
-
-#if FW_STORAGE_DEBUG
-    printf("releasing flash memory (desc: %d)\n", desc);
-#endif
-    ret = sys_cfg(CFG_DEV_RELEASE, desc);
-    if (ret != SYS_E_DONE) {
+    if (fw_storage_release(area)) {
         printf("unable to release flash memory device\n");
         return 1;
     }
-
-
-    /* lock flash CR */
-    flash_lock();
-    /* unmap flash-ctrl */
-    desc = flash_get_descriptor(CTRL);
-
-#if FW_STORAGE_DEBUG
-    printf("unmapping flash-ctrl (desc: %d)\n", desc);
-#endif
-    ret = sys_cfg(CFG_DEV_UNMAP, desc);
-    if (ret != SYS_E_DONE) {
+    /* lock, unmap and release storage ctrl */
+    if (fw_storage_unmap(FW_STORAGE_CTRL)) {
         printf("unable to unmap flash-ctrl device\n");
         return 1;
     }
-
-#if FW_STORAGE_DEBUG
-    printf("releasing flash-ctrl (desc: %d)\n", desc);
-#endif
-    ret = sys_cfg(CFG_DEV_RELEASE, desc);
-    if (ret != SYS_E_DONE) {
+    if (fw_storage_release(FW_STORAGE_CTRL)) {
         printf("unable to release flash-ctrl device\n");
         return 1;
     }
-
     return 0;
 }
 
 /*
  * Here we consider we write *words*. This means that the size must be
- * 4bytes multiple. Size is still in bytes.
+ * 4bytes multiple. Size is still in bytes. The data is handled as bytes,
+ * whatever its alignment: the backends load the words themselves.
  */
+static uint8_t fw_storage_write(physaddr_t dest, const uint8_t *buffer, uint32_t size)
+{
+    if (!is_in_flip_mode() && !is_in_flop_mode()) {
+        printf("neither in flip or flop mode !\n");
+        return 1;
+    }
+    /* wait for the destination sectors to be erased */
+    if (dest < erase_sched.end && fw_storage_erase_until(dest + size)) {
+        return 1;
+    }
+    if (storage_diff) {
+        /* identical sectors are not programmed */
+        physaddr_t addr = dest;
+        const uint8_t *data = buffer;
+        uint32_t todo = size;
+        while (todo) {
+            physaddr_t end = addr + todo;
+            uint32_t piece;
+            bool identical = fw_sector_diff_lookup(storage_diff, addr, &end);
+            piece = (end - addr < todo) ? (end - addr) : todo;
+            if (!identical && fw_storage_program(addr, data, piece)) {
+                return 1;
+            }
+            addr += piece;
+            data += piece;
+            todo -= piece;
+        }
+    } else if (fw_storage_program(dest, buffer, size)) {
+        return 1;
+    }
+    /* update the bank digest table with the programmed content */
+    fw_digest_update(dest, size);
+
+    return 0;
+}
+
 uint8_t fw_storage_write_buffer(physaddr_t dest, uint32_t *buffer, uint32_t size)
 {
-    uint8_t sector;
-    if (is_in_flip_mode()) {
-        /* sanitize */
-        sector = flash_select_sector(dest);
-        if (sector < 11) {
-            printf("destination not in the other bank !!!\n");
+    return fw_storage_write(dest, (const uint8_t*)buffer, size);
+}
+
+uint8_t fw_storage_writev(physaddr_t dest, const fw_iovec_t *iov, uint32_t iovcnt)
+{
+    uint32_t word = 0;      /* word crossing a segment boundary */
+    uint32_t pending = 0;   /* bytes already held by word */
+    physaddr_t addr = dest;
+
+    if ((iov == NULL && iovcnt) || (dest % 4)) {
+        return 1;
+    }
+    for (uint32_t i = 0; i < iovcnt; ++i) {
+        const uint8_t *data = (const uint8_t*)iov[i].base;
+        uint32_t len = iov[i].len;
+        uint32_t bulk;
+
+        if (data == NULL && len) {
             return 1;
         }
-    } else if (is_in_flop_mode()) {
-        /* sanitize */
-        sector = flash_select_sector(dest);
-        if (sector > 12) {
-            printf("destination not in the other bank !!!\n");
-            return 1;
+        /* complete the pending word first */
+        if (pending) {
+            uint32_t fill = (len < 4 - pending) ? len : (4 - pending);
+            memcpy((uint8_t*)&word + pending, data, fill);
+            pending += fill;
+            data += fill;
+            len -= fill;
+            if (pending < 4) {
+                continue;
+            }
+            if (fw_storage_write(addr, (const uint8_t*)&word, 4)) {
+                return 1;
+            }
+            addr += 4;
+            pending = 0;
         }
-    } else {
-        printf("neither in flip or flop mode !\n");
+        /* the whole words of the segment are programmed in place, the
+         * segment data being possibly misaligned */
+        bulk = len - (len % 4);
+        if (bulk) {
+            if (fw_storage_write(addr, data, bulk)) {
+                return 1;
+            }
+            addr += bulk;
+            data += bulk;
+            len -= bulk;
+        }
+        if (len) {
+            memcpy(&word, data, len);
+            pending = len;
+        }
+    }
+    /* trailing bytes of the last segment */
+    if (pending && fw_storage_write(addr, (const uint8_t*)&word, pending)) {
         return 1;
     }
+    return 0;
+}
 
-    uint32_t *addr = (uint32_t *)dest;
-    uint32_t *offset = buffer;
-    uint32_t residue = 0;
-    uint32_t aligned_size = size - (size % 4);
-    if (size % 4) {
-        /* size is not word-aligned ! a residue is needed */
-        residue = size % 4;
-    }
-    for (uint32_t i = 0; i < (aligned_size / 4); ++i) {
-        flash_program_word(addr, *offset);
-        addr++;
-        offset++;
-    }
-    /* if size is not 4 bytes aligned, finish with the up
-     * to 3 bytes to write */
-    if (residue) {
-        uint8_t *u8_addr  = (uint8_t*)addr;
-        uint8_t *u8_offset  = (uint8_t*)offset;
-        for (uint32_t i = 0; i < residue; ++i) {
-            /* FIXME: cast here is brainfuck. Should be made cleaner */
-            flash_program_byte(u8_addr, *u8_offset);
-            u8_addr++;
-            u8_offset++;
-        }
-    }
+/*
+ * Time-sliced writes
+ */
 
+uint8_t fw_storage_set_slice_budget(const fw_slice_budget_t *budget)
+{
+    /* slices are word-aligned */
+    if (budget == NULL || (budget->bytes % 4) ||
+        (budget->usecs && budget->clock_us == NULL)) {
+        return 1;
+    }
+    slice_budget = *budget;
+    return 0;
+}
 
+uint8_t fw_storage_write_start(fw_write_cursor_t *cursor, physaddr_t dest,
+                               uint32_t *buffer, uint32_t size)
+{
+    if (cursor == NULL || (buffer == NULL && size)) {
+        return 1;
+    }
+    cursor->dest = dest;
+    cursor->buffer = (const uint8_t*)buffer;
+    cursor->size = size;
+    cursor->done = 0;
     return 0;
 }
 
+bool fw_storage_write_done(const fw_write_cursor_t *cursor)
+{
+    return (cursor == NULL || cursor->done >= cursor->size);
+}
 
+uint8_t fw_storage_write_slice(fw_write_cursor_t *cursor)
+{
+    uint32_t budget = slice_budget.bytes;
+    uint32_t written = 0;
+    uint64_t start = 0;
+
+    if (cursor == NULL) {
+        return 1;
+    }
+    if (slice_budget.usecs) {
+        start = slice_budget.clock_us();
+    }
+    while (!fw_storage_write_done(cursor)) {
+        physaddr_t addr = cursor->dest + cursor->done;
+        uint32_t todo = cursor->size - cursor->done;
+
+        if (budget && todo > budget) {
+            todo = budget;
+        }
+        if (slice_budget.usecs && todo > FW_SLICE_STEP) {
+            todo = FW_SLICE_STEP;
+        }
+        /* a sector erase is never split: it is the whole slice */
+        if (erase_sched.active && addr < erase_sched.end &&
+            erase_sched.cursor < addr + todo) {
+            if (written) {
+                break;
+            }
+            return fw_storage_erase_poll(1);
+        }
+        if (fw_storage_write(addr, cursor->buffer + cursor->done, todo)) {
+            return 1;
+        }
+        cursor->done += todo;
+        written += todo;
+        if (budget) {
+            budget -= todo;
+            if (budget == 0) {
+                break;
+            }
+        }
+        if (slice_budget.usecs &&
+            (slice_budget.clock_us() - start) >= slice_budget.usecs) {
+            break;
+        }
+    }
+    return 0;
+}
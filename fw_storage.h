@@ -1,11 +1,58 @@
 #ifndef FW_STORAGE_H_
 #define FW_STORAGE_H_
 
+#include "autoconf.h"
 #include "libc/types.h"
 #include "libflash.h"
+#include "api/libfw.h"
 
 uint8_t fw_storage_early_init(t_device_mapping *devmap);
 
 uint8_t fw_storage_init(void);
 
+/*
+ * Current storage backend accessors
+ */
+uint8_t fw_storage_map(fw_storage_area_t area);
+
+uint8_t fw_storage_unmap(fw_storage_area_t area);
+
+uint8_t fw_storage_release(fw_storage_area_t area);
+
+uint8_t fw_storage_erase_range(physaddr_t addr, uint32_t len);
+
+uint32_t fw_storage_sector_size(physaddr_t addr);
+
+uint8_t fw_storage_program(physaddr_t dest, const uint8_t *src, uint32_t size);
+
+/*
+ * Return true if [addr, addr + size[ is in the other bank or in its bootinfo,
+ * the only areas the current mode may erase or program. Programs and erases
+ * are checked by the accessors above, whatever the backend.
+ */
+bool fw_storage_is_writable(physaddr_t addr, uint32_t size);
+
+/* direct read access to the storage content at addr (NULL if no backend) */
+const void *fw_storage_addr(physaddr_t addr);
+
+/*
+ * Sector-diff helpers
+ */
+
+/* hash the bank sectors and mark the ones matching their digest */
+uint8_t fw_sector_diff_compare(fw_sector_diff_t *diff, physaddr_t base,
+                               const firmware_sector_digest_t *digests, uint32_t count);
+
+/* return true if addr is in an identical sector, ending at *sector_end */
+bool fw_sector_diff_lookup(const fw_sector_diff_t *diff, physaddr_t addr, physaddr_t *sector_end);
+
+#if CONFIG_USR_DRV_FLASH
+/*
+ * Flash (libflash) backend
+ */
+extern const fw_storage_ops_t fw_storage_flash_ops;
+
+uint8_t fw_storage_flash_early_init(t_device_mapping *devmap);
+#endif
+
 #endif/*!FW_STORAGE_H_*/
@@ -0,0 +1,170 @@
+#include "autoconf.h"
+#include "api/libfw.h"
+#include "libc/types.h"
+#include "libc/stdio.h"
+#include "fw_storage.h"
+
+/*
+ * Memory-mapped file storage backend (Linux hosts only).
+ *
+ * The file holds a raw image of the storage, starting at the storage base
+ * address. It is memory-mapped and handled as a RAM backend storage, so
+ * that erase and program directly work on the mapping (with the NOR flash
+ * semantic), without any copy. The mapping is synced back to the file only
+ * when an area is released (i.e. at fw_storage_finalize_access() time) and
+ * when the file is closed.
+ */
+
+#if defined(__linux__)
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static int      file_fd = -1;
+static uint8_t *file_mem = NULL;
+static uint32_t file_size = 0;
+
+uint8_t fw_storage_file_open(const char *path, physaddr_t base, uint32_t size, uint32_t sector_size)
+{
+    struct stat st;
+    uint32_t cur_size;
+
+    if (file_mem != NULL || path == NULL || size == 0) {
+        return 1;
+    }
+    file_fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (file_fd < 0) {
+        printf("unable to open %s\n", path);
+        return 1;
+    }
+    if (fstat(file_fd, &st) != 0 || (uint64_t)st.st_size > size) {
+        printf("invalid storage image %s\n", path);
+        goto err;
+    }
+    cur_size = st.st_size;
+    if (cur_size < size && ftruncate(file_fd, size) != 0) {
+        printf("unable to resize %s\n", path);
+        goto err;
+    }
+    file_mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file_fd, 0);
+    if (file_mem == MAP_FAILED) {
+        printf("unable to map %s\n", path);
+        file_mem = NULL;
+        goto err;
+    }
+    file_size = size;
+    /* a new (or grown) image content is an erased storage */
+    if (cur_size < size) {
+        memset(file_mem + cur_size, 0xff, size - cur_size);
+    }
+    if (fw_storage_ram_init(file_mem, base, size, sector_size)) {
+        fw_storage_file_close();
+        return 1;
+    }
+    return 0;
+
+err:
+    close(file_fd);
+    file_fd = -1;
+    return 1;
+}
+
+uint8_t fw_storage_file_sync(void)
+{
+    if (file_mem == NULL) {
+        return 1;
+    }
+    if (msync(file_mem, file_size, MS_SYNC) != 0) {
+        printf("unable to sync storage image\n");
+        return 1;
+    }
+    return 0;
+}
+
+uint8_t fw_storage_file_close(void)
+{
+    uint8_t ok = 0;
+
+    if (file_mem == NULL) {
+        return 1;
+    }
+    ok = fw_storage_file_sync();
+    munmap(file_mem, file_size);
+    close(file_fd);
+    file_mem = NULL;
+    file_size = 0;
+    file_fd = -1;
+    return ok;
+}
+
+static uint8_t file_map(fw_storage_area_t area)
+{
+    (void)area;
+    return (file_mem == NULL) ? 1 : 0;
+}
+
+static uint8_t file_unmap(fw_storage_area_t area)
+{
+    (void)area;
+    return 0;
+}
+
+static uint8_t file_release(fw_storage_area_t area)
+{
+    (void)area;
+    /* the area won't be accessed anymore, sync its content */
+    return fw_storage_file_sync();
+}
+
+static uint8_t file_erase_range(physaddr_t addr, uint32_t len)
+{
+    return fw_storage_ram_ops.erase_range(addr, len);
+}
+
+static uint8_t file_erase_begin(physaddr_t addr)
+{
+    return fw_storage_ram_ops.erase_begin(addr);
+}
+
+static bool file_erase_busy(void)
+{
+    return fw_storage_ram_ops.erase_busy();
+}
+
+static uint32_t file_sector_size(physaddr_t addr)
+{
+    return fw_storage_ram_ops.sector_size(addr);
+}
+
+static uint8_t file_program(physaddr_t dest, const uint8_t *src, uint32_t size)
+{
+    return fw_storage_ram_ops.program(dest, src, size);
+}
+
+static uint8_t file_read(physaddr_t src, uint8_t *dest, uint32_t size)
+{
+    return fw_storage_ram_ops.read(src, dest, size);
+}
+
+static const void *file_addr(physaddr_t addr)
+{
+    return fw_storage_ram_ops.addr(addr);
+}
+
+const fw_storage_ops_t fw_storage_file_ops = {
+    .map         = file_map,
+    .unmap       = file_unmap,
+    .release     = file_release,
+    .erase_range = file_erase_range,
+    .sector_size = file_sector_size,
+    .program     = file_program,
+    .read        = file_read,
+    .addr        = file_addr,
+    .erase_begin = file_erase_begin,
+    .erase_busy  = file_erase_busy,
+};
+
+#endif
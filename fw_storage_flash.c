@@ -0,0 +1,280 @@
+#include "autoconf.h"
+#include "api/libfw.h"
+#include "libc/types.h"
+#include "libc/stdio.h"
+#include "libc/nostd.h"
+#include "libc/string.h"
+#include "libc/syscall.h"
+#include "libflash.h"
+#include "fw_storage.h"
+
+/*
+ * Flash storage backend, based on the libflash and the EwoK devices.
+ */
+
+#if CONFIG_USR_DRV_FLASH
+
+#define FW_STORAGE_DEBUG 0
+
+/* flash sectors base addresses, for the current flash configuration */
+static const physaddr_t flash_sectors[] = {
+    FLASH_SECTOR_0,
+    FLASH_SECTOR_1,
+    FLASH_SECTOR_2,
+    FLASH_SECTOR_3,
+    FLASH_SECTOR_4,
+    FLASH_SECTOR_5,
+    FLASH_SECTOR_6,
+    FLASH_SECTOR_7,
+# if (CONFIG_USR_DRV_FLASH_1M && !CONFIG_USR_DRV_FLASH_DUAL_BANK) || CONFIG_USR_DRV_FLASH_2M
+    FLASH_SECTOR_8,
+    FLASH_SECTOR_9,
+    FLASH_SECTOR_10,
+    FLASH_SECTOR_11,
+#endif
+# if (CONFIG_USR_DRV_FLASH_1M && CONFIG_USR_DRV_FLASH_DUAL_BANK) || CONFIG_USR_DRV_FLASH_2M
+    FLASH_SECTOR_12,
+    FLASH_SECTOR_13,
+    FLASH_SECTOR_14,
+    FLASH_SECTOR_15,
+    FLASH_SECTOR_16,
+    FLASH_SECTOR_17,
+    FLASH_SECTOR_18,
+    FLASH_SECTOR_19,
+#endif
+# if CONFIG_USR_DRV_FLASH_2M
+    FLASH_SECTOR_20,
+    FLASH_SECTOR_21,
+    FLASH_SECTOR_22,
+    FLASH_SECTOR_23,
+#endif
+};
+
+#define FLASH_SECTORS_NUM (sizeof(flash_sectors) / sizeof(physaddr_t))
+
+/* index of the sector holding addr (addr being in the flash) */
+static uint32_t flash_sector_index(physaddr_t addr)
+{
+    uint32_t lo = 0;
+    uint32_t hi = FLASH_SECTORS_NUM - 1;
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi + 1) / 2;
+        if (flash_sectors[mid] <= addr) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+static uint8_t flash_area_descriptor(fw_storage_area_t area, int *desc)
+{
+    switch (area) {
+        case FW_STORAGE_CTRL:
+            *desc = flash_get_descriptor(CTRL);
+            break;
+        case FW_STORAGE_CTRL2:
+            *desc = flash_get_descriptor(CTRL2);
+            break;
+        case FW_STORAGE_FLIP:
+            *desc = flash_get_descriptor(FLIP);
+            break;
+        case FW_STORAGE_FLOP:
+            *desc = flash_get_descriptor(FLOP);
+            break;
+        case FW_STORAGE_FLIP_SHR:
+            *desc = flash_get_descriptor(FLIP_SHR);
+            break;
+        case FW_STORAGE_FLOP_SHR:
+            *desc = flash_get_descriptor(FLOP_SHR);
+            break;
+        default:
+            return 1;
+    }
+    return 0;
+}
+
+static inline bool flash_area_is_ctrl(fw_storage_area_t area)
+{
+    return (area == FW_STORAGE_CTRL || area == FW_STORAGE_CTRL2);
+}
+
+static uint8_t flash_map(fw_storage_area_t area)
+{
+    uint8_t ret;
+    int desc;
+
+    if (flash_area_descriptor(area, &desc)) {
+        return 1;
+    }
+#if FW_STORAGE_DEBUG
+    printf("mapping flash device (desc: %d)\n", desc);
+#endif
+    ret = sys_cfg(CFG_DEV_MAP, desc);
+    if (ret != SYS_E_DONE) {
+        return 1;
+    }
+    if (flash_area_is_ctrl(area)) {
+        /* unlocking flash */
+        flash_unlock();
+    }
+    return 0;
+}
+
+static uint8_t flash_unmap(fw_storage_area_t area)
+{
+    uint8_t ret;
+    int desc;
+
+    if (flash_area_descriptor(area, &desc)) {
+        return 1;
+    }
+    if (flash_area_is_ctrl(area)) {
+        /* lock flash CR */
+        flash_lock();
+    }
+#if FW_STORAGE_DEBUG
+    printf("unmapping flash device (desc: %d)\n", desc);
+#endif
+    ret = sys_cfg(CFG_DEV_UNMAP, desc);
+    if (ret != SYS_E_DONE) {
+        return 1;
+    }
+    return 0;
+}
+
+static uint8_t flash_release(fw_storage_area_t area)
+{
+    uint8_t ret;
+    int desc;
+
+    if (flash_area_descriptor(area, &desc)) {
+        return 1;
+    }
+#if FW_STORAGE_DEBUG
+    printf("releasing flash device (desc: %d)\n", desc);
+#endif
+    ret = sys_cfg(CFG_DEV_RELEASE, desc);
+    if (ret != SYS_E_DONE) {
+        return 1;
+    }
+    return 0;
+}
+
+static uint32_t flash_sector_size(physaddr_t addr)
+{
+    uint32_t i;
+
+    if (addr < flash_sectors[0]) {
+        return 0;
+    }
+    i = flash_sector_index(addr);
+    if (i + 1 < FLASH_SECTORS_NUM) {
+        return flash_sectors[i + 1] - flash_sectors[i];
+    }
+    /* the last sector has the same size as the previous one */
+    return flash_sectors[FLASH_SECTORS_NUM - 1] - flash_sectors[FLASH_SECTORS_NUM - 2];
+}
+
+static uint8_t flash_erase_range(physaddr_t addr, uint32_t len)
+{
+    physaddr_t end = addr + len;
+    uint32_t first, last;
+
+    /* the range is checked against the firmware layout by fw_storage.c */
+    if (len == 0 || addr < flash_sectors[0] || end < addr) {
+        return 1;
+    }
+    first = flash_sector_index(addr);
+    last = flash_sector_index(end - 1);
+    /* erase the sectors overlapping the range */
+    for (uint32_t i = first; i <= last; ++i) {
+#if FW_STORAGE_DEBUG
+        printf("erasing sector @%x\n", flash_sectors[i]);
+#endif
+        flash_sector_erase(flash_sectors[i]);
+    }
+    return 0;
+}
+
+static uint8_t flash_program(physaddr_t dest, const uint8_t *src, uint32_t size)
+{
+    /* dest is checked against the firmware layout by fw_storage.c */
+    uint32_t *addr = (uint32_t *)dest;
+    const uint8_t *offset = src;
+    uint32_t residue = 0;
+    uint32_t aligned_size = size - (size % 4);
+    if (size % 4) {
+        /* size is not word-aligned ! a residue is needed */
+        residue = size % 4;
+    }
+    for (uint32_t i = 0; i < (aligned_size / 4); ++i) {
+        uint32_t word;
+        /* src may not be word-aligned */
+        memcpy(&word, offset, sizeof(word));
+        flash_program_word(addr, word);
+        addr++;
+        offset += sizeof(word);
+    }
+    /* if size is not 4 bytes aligned, finish with the up
+     * to 3 bytes to write */
+    if (residue) {
+        uint8_t *u8_addr  = (uint8_t*)addr;
+        const uint8_t *u8_offset  = offset;
+        for (uint32_t i = 0; i < residue; ++i) {
+            flash_program_byte(u8_addr, *u8_offset);
+            u8_addr++;
+            u8_offset++;
+        }
+    }
+    return 0;
+}
+
+static uint8_t flash_read(physaddr_t src, uint8_t *dest, uint32_t size)
+{
+    /* flash is memory-mapped */
+    memcpy(dest, (const void*)src, size);
+    return 0;
+}
+
+static const void *flash_addr(physaddr_t addr)
+{
+    return (const void*)addr;
+}
+
+uint8_t fw_storage_flash_early_init(t_device_mapping *devmap)
+{
+    int ret = 0;
+
+    if (devmap) {
+        ret = flash_device_early_init(devmap);
+    } else {
+        printf("unable to declare flash!\n");
+        ret = 1;
+    }
+    if (ret != 0) {
+        goto err;
+    }
+    return 0;
+
+err:
+    return 1;
+}
+
+const fw_storage_ops_t fw_storage_flash_ops = {
+    .map         = flash_map,
+    .unmap       = flash_unmap,
+    .release     = flash_release,
+    .erase_range = flash_erase_range,
+    .sector_size = flash_sector_size,
+    .program     = flash_program,
+    .read        = flash_read,
+    .addr        = flash_addr,
+    /* flash_sector_erase() waits for the end of the erase: no split erase */
+    .erase_begin = NULL,
+    .erase_busy  = NULL,
+};
+
+#endif
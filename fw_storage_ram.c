@@ -0,0 +1,157 @@
+#include "autoconf.h"
+#include "api/libfw.h"
+#include "libc/types.h"
+#include "libc/stdio.h"
+#include "libc/nostd.h"
+#include "libc/string.h"
+#include "fw_storage.h"
+
+/*
+ * RAM storage backend: the storage is emulated in memory, with the NOR
+ * flash semantic (erase set bytes to 0xff, program only clears bits).
+ * Useful to run or stress the update logic at memory speed.
+ */
+
+static uint8_t   *ram_mem = NULL;
+static physaddr_t ram_base = 0;
+static uint32_t   ram_size = 0;
+static uint32_t   ram_sector_size = 0;
+/* started sector erase, emulating the erase time (see ram_erase_busy()) */
+static physaddr_t ram_erase_addr = 0;
+static uint8_t    ram_erase_polls = 0;
+
+uint8_t fw_storage_ram_init(uint8_t *mem, physaddr_t base, uint32_t size, uint32_t sector_size)
+{
+    if (mem == NULL || size == 0 || sector_size == 0 || (size % sector_size) ||
+        (base % sector_size)) {
+        return 1;
+    }
+    ram_mem = mem;
+    ram_base = base;
+    ram_size = size;
+    ram_sector_size = sector_size;
+    ram_erase_polls = 0;
+    return 0;
+}
+
+static inline bool ram_in_range(physaddr_t addr, uint32_t len)
+{
+    return (ram_mem != NULL && addr >= ram_base &&
+            (addr - ram_base) <= ram_size && len <= ram_size - (addr - ram_base));
+}
+
+static uint8_t ram_map(fw_storage_area_t area)
+{
+    (void)area;
+    return (ram_mem == NULL) ? 1 : 0;
+}
+
+static uint8_t ram_unmap(fw_storage_area_t area)
+{
+    (void)area;
+    return 0;
+}
+
+static uint8_t ram_release(fw_storage_area_t area)
+{
+    (void)area;
+    return 0;
+}
+
+static uint8_t ram_erase_range(physaddr_t addr, uint32_t len)
+{
+    uint32_t start, end;
+
+    if (len == 0 || !ram_in_range(addr, len)) {
+        return 1;
+    }
+    /* erase the whole overlapping sectors */
+    start = addr - ram_base;
+    start -= start % ram_sector_size;
+    end = (addr - ram_base) + len;
+    if (end % ram_sector_size) {
+        end += ram_sector_size - (end % ram_sector_size);
+    }
+    memset(ram_mem + start, 0xff, end - start);
+    return 0;
+}
+
+/*
+ * Split sector erase: the sector is reported busy on the first erase_busy()
+ * call, and is erased on the next one, as a flash controller would complete
+ * it later on.
+ */
+static uint8_t ram_erase_begin(physaddr_t addr)
+{
+    if (ram_erase_polls || !ram_in_range(addr, 1)) {
+        return 1;
+    }
+    ram_erase_addr = addr;
+    ram_erase_polls = 2;
+    return 0;
+}
+
+static bool ram_erase_busy(void)
+{
+    if (ram_erase_polls == 0) {
+        return false;
+    }
+    if (--ram_erase_polls) {
+        return true;
+    }
+    ram_erase_range(ram_erase_addr, 1);
+    return false;
+}
+
+static uint32_t ram_sector_size_of(physaddr_t addr)
+{
+    if (!ram_in_range(addr, 1)) {
+        return 0;
+    }
+    return ram_sector_size;
+}
+
+static uint8_t ram_program(physaddr_t dest, const uint8_t *src, uint32_t size)
+{
+    uint8_t *mem;
+
+    if (!ram_in_range(dest, size)) {
+        printf("destination out of storage !!!\n");
+        return 1;
+    }
+    mem = ram_mem + (dest - ram_base);
+    for (uint32_t i = 0; i < size; ++i) {
+        mem[i] &= src[i];
+    }
+    return 0;
+}
+
+static uint8_t ram_read(physaddr_t src, uint8_t *dest, uint32_t size)
+{
+    if (!ram_in_range(src, size)) {
+        return 1;
+    }
+    memcpy(dest, ram_mem + (src - ram_base), size);
+    return 0;
+}
+
+static const void *ram_addr(physaddr_t addr)
+{
+    if (!ram_in_range(addr, 0)) {
+        return NULL;
+    }
+    return ram_mem + (addr - ram_base);
+}
+
+const fw_storage_ops_t fw_storage_ram_ops = {
+    .map         = ram_map,
+    .unmap       = ram_unmap,
+    .release     = ram_release,
+    .erase_range = ram_erase_range,
+    .sector_size = ram_sector_size_of,
+    .program     = ram_program,
+    .read        = ram_read,
+    .addr        = ram_addr,
+    .erase_begin = ram_erase_begin,
+    .erase_busy  = ram_erase_busy,
+};
@@ -0,0 +1,319 @@
+/* \file fw_update.c
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+#include "autoconf.h"
+#include "api/libfw.h"
+#include "libc/types.h"
+#include "libc/stdio.h"
+#include "libc/nostd.h"
+#include "libc/string.h"
+#include "fw_storage.h"
+#include "fw_shr.h"
+#include "fw_sig_gate.h"
+#include "shr.h"
+
+/*
+ * Streaming update engine: the received bytes are consumed by the current
+ * state (header, signature, payload). The payload is programmed from the
+ * caller fragments through fw_storage_writev(), the bytes of an incomplete
+ * trailing word being kept in the context until the next fragment. As the
+ * bank base is word-aligned, these are the received % 4 last bytes.
+ *
+ * The committed hash is the SHA256 of the received payload, i.e. the one the
+ * signature covers (with USR_LIB_FIRMWARE_WRITE_HASH, the hash of the
+ * programmed content is only compared to it). Once the payload is received,
+ * the engine arms the speculative update gate with this hash and runs the
+ * caller verifier through it: the header is committed only if the gate
+ * holds a successful verification of this very header, signature and hash.
+ */
+
+#define FW_UPDATE_FORMAT_Msk (FW_TYPE_SPARSE | FW_TYPE_MERKLE | FW_TYPE_SECTOR_DIFF | FW_TYPE_ENCRYPTED)
+
+static inline uint32_t fw_update_min(uint32_t a, uint32_t b)
+{
+    return (a < b) ? a : b;
+}
+
+static void fw_update_fail(fw_update_t *ctx)
+{
+    if (ctx->state == FW_UPDATE_PAYLOAD) {
+        fw_storage_release_access();
+    }
+    if (ctx->state == FW_UPDATE_VERIFY) {
+        fw_sig_cancel();
+    }
+    ctx->state = FW_UPDATE_ERROR;
+}
+
+/* gate step function: run the next step of the caller verifier */
+static fw_sig_state_t fw_update_verify_step(void *arg)
+{
+    fw_update_t *ctx = (fw_update_t*)arg;
+
+    return ctx->verify(ctx->verify_ctx, &ctx->header, ctx->sig, ctx->hash);
+}
+
+/* the header is fully received */
+static uint8_t fw_update_header(fw_update_t *ctx)
+{
+    if (firmware_parse_header(ctx->stage.raw, sizeof(ctx->stage.raw), 0, &ctx->header, NULL) != 0) {
+        ctx->admit = FW_REJECT_HEADER;
+        return 1;
+    }
+    ctx->admit = fw_update_admit(&ctx->header);
+    if (ctx->admit == FW_ADMIT_OK && (ctx->header.type & FW_UPDATE_FORMAT_Msk)) {
+        /* these formats keep their dedicated API */
+        ctx->admit = FW_REJECT_TYPE;
+    }
+    if (ctx->admit != FW_ADMIT_OK) {
+        printf("update rejected: %s\n", fw_admit_reason(ctx->admit));
+        return 1;
+    }
+    return 0;
+}
+
+/* the signature is fully received: the bank update starts */
+static uint8_t fw_update_start(fw_update_t *ctx)
+{
+    ctx->base = is_in_flip_mode() ? CONFIG_USR_LIB_FIRMWARE_FLOP_ADDR :
+                                    CONFIG_USR_LIB_FIRMWARE_FLIP_ADDR;
+    /* the other bank must not be bootable while being written */
+    if (clear_other_header()) {
+        printf("unable to clear the other bank header\n");
+        return 1;
+    }
+    if (fw_storage_prepare_access()) {
+        return 1;
+    }
+    if (fw_storage_erase_start()) {
+        fw_storage_release_access();
+        return 1;
+    }
+    sha256_init(&ctx->sha);
+    return 0;
+}
+
+static uint8_t fw_update_payload(fw_update_t *ctx, const uint8_t *data, uint32_t len)
+{
+    uint32_t pending = ctx->received % 4;
+    uint32_t total = pending + len;
+    uint32_t todo;
+
+    /* the bank is programmed by words, except the image last bytes */
+    if (ctx->received + len == ctx->header.len) {
+        todo = total;
+    } else {
+        todo = total - (total % 4);
+    }
+    if (todo) {
+        fw_iovec_t iov[2];
+
+        iov[0].base = &ctx->stage.tail;
+        iov[0].len = pending;
+        iov[1].base = data;
+        iov[1].len = todo - pending;
+        if (fw_storage_writev(ctx->base + ctx->received - pending, iov, 2)) {
+            printf("unable to write payload at offset %x\n", ctx->received - pending);
+            return 1;
+        }
+        memcpy((uint8_t*)&ctx->stage.tail, data + (todo - pending), total - todo);
+    } else {
+        memcpy((uint8_t*)&ctx->stage.tail + pending, data, len);
+    }
+    sha256_update(&ctx->sha, data, len);
+    ctx->received += len;
+    return 0;
+}
+
+/* the payload is fully received: the bank is finalized and verified */
+static uint8_t fw_update_verify(fw_update_t *ctx)
+{
+    sha256_final(&ctx->sha, ctx->hash);
+#if CONFIG_USR_LIB_FIRMWARE_WRITE_HASH
+    {
+        uint8_t check[SHA256_DIGEST_SIZE];
+        /* the programmed content must be the received one */
+        if (fw_storage_get_hash(ctx->header.len, check) ||
+            memcmp(check, ctx->hash, SHA256_DIGEST_SIZE) != 0) {
+            printf("programmed content doesn't match the received payload\n");
+            return 1;
+        }
+    }
+#endif
+    /* the access is released even if the finalization fails */
+    ctx->state = FW_UPDATE_ERROR;
+    if (fw_storage_finalize_access()) {
+        return 1;
+    }
+    if (fw_sig_speculate(&ctx->header, ctx->sig, ctx->hash, fw_update_verify_step, ctx)) {
+        return 1;
+    }
+    ctx->state = FW_UPDATE_VERIFY;
+    return 0;
+}
+
+/* the signature is verified: the bank header is committed */
+static uint8_t fw_update_commit(fw_update_t *ctx)
+{
+    /* never commit without a successful verification */
+    if (fw_sig_gate_check(&ctx->header, ctx->sig, ctx->hash, true)) {
+        return 1;
+    }
+#if !CONFIG_USR_LIB_FIRMWARE_SHR_LOG
+    if (is_in_flip_mode() ?
+        fw_shr_erase(FW_STORAGE_FLOP_SHR, CONFIG_USR_LIB_FIRMWARE_FLOP_BOOTINFO_ADDR) :
+        fw_shr_erase(FW_STORAGE_FLIP_SHR, CONFIG_USR_LIB_FIRMWARE_FLIP_BOOTINFO_ADDR)) {
+        return 1;
+    }
+#endif
+    if (set_fw_header(&ctx->header, ctx->sig, ctx->hash)) {
+        printf("unable to commit the bank header\n");
+        return 1;
+    }
+    ctx->state = FW_UPDATE_DONE;
+    return 0;
+}
+
+uint8_t fw_update_init(fw_update_t *ctx, fw_update_verify_t verify, void *verify_ctx)
+{
+    if (ctx == NULL || verify == NULL) {
+        return 1;
+    }
+    memset(ctx, 0, sizeof(fw_update_t));
+    ctx->verify = verify;
+    ctx->verify_ctx = verify_ctx;
+    ctx->state = FW_UPDATE_HEADER;
+    /* the gate is owned by the engine until the end of the update */
+    fw_sig_cancel();
+    return 0;
+}
+
+uint8_t fw_update_feed(fw_update_t *ctx, const uint8_t *data, uint32_t len)
+{
+    uint32_t todo;
+
+    if (ctx == NULL || (data == NULL && len)) {
+        return 1;
+    }
+    /* nothing more is expected once the header is committed */
+    if (ctx->state == FW_UPDATE_ERROR || (ctx->state == FW_UPDATE_DONE && len)) {
+        return 1;
+    }
+    while (len || ctx->state == FW_UPDATE_PAYLOAD || ctx->state == FW_UPDATE_VERIFY) {
+        switch (ctx->state) {
+            case FW_UPDATE_HEADER:
+                todo = fw_update_min(len, sizeof(firmware_header_t) - ctx->hdr_received);
+                memcpy(ctx->stage.raw + ctx->hdr_received, data, todo);
+                ctx->hdr_received += todo;
+                if (ctx->hdr_received == sizeof(firmware_header_t)) {
+                    if (fw_update_header(ctx)) {
+                        goto err;
+                    }
+                    ctx->state = FW_UPDATE_SIG;
+                }
+                break;
+            case FW_UPDATE_SIG:
+                todo = fw_update_min(len, sizeof(firmware_header_t) + ctx->header.siglen -
+                                          ctx->hdr_received);
+                memcpy(ctx->sig + ctx->hdr_received - sizeof(firmware_header_t), data, todo);
+                ctx->hdr_received += todo;
+                if (ctx->hdr_received == sizeof(firmware_header_t) + ctx->header.siglen) {
+                    if (fw_update_start(ctx)) {
+                        goto err;
+                    }
+                    ctx->state = FW_UPDATE_PAYLOAD;
+                }
+                break;
+            case FW_UPDATE_PAYLOAD:
+                /* progress the background erase, even without data */
+                if (fw_storage_erase_poll(1)) {
+                    goto err;
+                }
+                if (len > ctx->header.len - ctx->received) {
+                    printf("unexpected data after the image\n");
+                    goto err;
+                }
+                todo = len;
+                if (todo && fw_update_payload(ctx, data, todo)) {
+                    goto err;
+                }
+                if (ctx->received == ctx->header.len && fw_update_verify(ctx)) {
+                    goto err;
+                }
+                if (ctx->state == FW_UPDATE_PAYLOAD) {
+                    /* fragment consumed */
+                    return 0;
+                }
+                break;
+            case FW_UPDATE_VERIFY:
+                if (len) {
+                    printf("unexpected data after the image\n");
+                    goto err;
+                }
+                /* one verifier step per call */
+                switch (fw_sig_poll()) {
+                    case FW_SIG_PENDING:
+                        return 0;
+                    case FW_SIG_VALID:
+                        if (fw_update_commit(ctx)) {
+                            goto err;
+                        }
+                        return 0;
+                    default:
+                        printf("invalid signature, update rejected\n");
+                        goto err;
+                }
+            default:
+                goto err;
+        }
+        data += todo;
+        len -= todo;
+    }
+    return 0;
+
+err:
+    fw_update_fail(ctx);
+    return 1;
+}
+
+fw_update_state_t fw_update_status(const fw_update_t *ctx, uint32_t *done, uint32_t *total)
+{
+    if (ctx == NULL) {
+        return FW_UPDATE_ERROR;
+    }
+    if (done) {
+        *done = ctx->received;
+    }
+    if (total) {
+        /* unknown until the header is received */
+        *total = (ctx->state == FW_UPDATE_HEADER) ? 0 : ctx->header.len;
+    }
+    return ctx->state;
+}
+
+void fw_update_abort(fw_update_t *ctx)
+{
+    if (ctx == NULL || ctx->state == FW_UPDATE_DONE) {
+        return;
+    }
+    fw_update_fail(ctx);
+}
@@ -65,10 +65,39 @@ typedef struct __packed {
     uint8_t sig[EC_MAX_SIGLEN];
 } t_firmware_signature;
 
+/* t_firmware_signature fields, up to the hash */
+typedef struct __packed {
+    uint32_t magic;
+    uint32_t type;
+    uint32_t version;
+    uint32_t len;
+    uint32_t siglen;
+    uint32_t chunksize;
+    uint32_t crc32;
+} t_firmware_sig_fields;
+
+
+/*
+ * Per-block CRC32 table of the firmware image, written at commit time in
+ * the SHR (in what was previously the 'fill' area) to support partial and
+ * incremental verification of a bank. When the table is not present
+ * (magic set to ERASE_VALUE), only the global hash can be used.
+ */
+#define FW_DIGEST_MAGIC      0x44474254
+#define FW_DIGEST_BLOCK_SIZE 4096
+#define FW_DIGEST_MAX_BLOCKS ((CONFIG_USR_LIB_FIRMWARE_BANK_SIZE + FW_DIGEST_BLOCK_SIZE - 1) / FW_DIGEST_BLOCK_SIZE)
+
+typedef struct __packed {
+    uint32_t magic;
+    uint32_t block_size;
+    uint32_t count;
+    uint32_t crc[FW_DIGEST_MAX_BLOCKS];
+} t_firmware_digests;
 
 typedef struct __packed {
     t_firmware_signature   fw_sig;
-    uint8_t                fill[SHR_SECTOR_SIZE - sizeof(t_firmware_signature)];
+    t_firmware_digests     digests;
+    uint8_t                fill[SHR_SECTOR_SIZE - sizeof(t_firmware_signature) - sizeof(t_firmware_digests)];
     uint32_t               bootable;
 } t_firmware_state;
 
@@ -76,4 +105,27 @@ typedef struct __packed {
         t_firmware_state fw;
 } shr_vars_t;
 
+/*
+ * Log-structured bootinfo (CONFIG_USR_LIB_FIRMWARE_SHR_LOG)
+ *
+ * The first bootinfo sector is an array of FW_RECORD_SLOT_SIZE slots. Records
+ * are appended in the first erased slot (magic set to ERASE_VALUE), so that
+ * the used slots are always a prefix of the sector. A record is valid when
+ * its crc32 (calculated on all the previous fields of the record, the unused
+ * signature bytes being erased) is correct. The valid record with the highest
+ * slot index is the current one. The fw_sig.crc32 field is not used.
+ */
+#define FW_RECORD_MAGIC 0x5245434f
+
+typedef struct __packed {
+    uint32_t             magic;
+    uint32_t             seq;
+    t_firmware_signature fw_sig;
+    uint32_t             bootable;
+    uint32_t             crc32;
+} t_firmware_record;
+
+#define FW_RECORD_SLOT_SIZE ((sizeof(t_firmware_record) + 3) & ~3)
+#define FW_RECORD_MAX       (SHR_SECTOR_SIZE / FW_RECORD_SLOT_SIZE)
+
 #endif
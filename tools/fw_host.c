@@ -0,0 +1,74 @@
+/* \file fw_host.c
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+#include "autoconf.h"
+#include "fw_host.h"
+
+/* host replacement of fw_mode.c */
+
+static partitions_types host_mode = PART_FLIP;
+
+void fw_host_set_mode(partitions_types running)
+{
+    host_mode = running;
+}
+
+bool is_in_flip_mode(void)
+{
+    return host_mode == PART_FLIP;
+}
+
+bool is_in_flop_mode(void)
+{
+    return host_mode == PART_FLOP;
+}
+
+bool is_in_fw_mode(void)
+{
+    return false;
+}
+
+/* the host build acts as the updater */
+bool is_in_dfu_mode(void)
+{
+    return true;
+}
+
+uint32_t firmware_get_flip_base_addr(void)
+{
+    return CONFIG_USR_LIB_FIRMWARE_FLIP_ADDR;
+}
+
+uint32_t firmware_get_flop_base_addr(void)
+{
+    return CONFIG_USR_LIB_FIRMWARE_FLOP_ADDR;
+}
+
+uint32_t firmware_get_flip_size(void)
+{
+    return CONFIG_USR_LIB_FIRMWARE_BANK_SIZE;
+}
+
+uint32_t firmware_get_flop_size(void)
+{
+    return CONFIG_USR_LIB_FIRMWARE_BANK_SIZE;
+}
@@ -0,0 +1,39 @@
+/* \file fw_host.h
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+#ifndef FW_HOST_H_
+#define FW_HOST_H_
+
+#include "libc/types.h"
+#include "api/libfw.h"
+
+/*
+ * Host build of the libfirmware.
+ *
+ * On the device, the current mode (flip, flop...) is given by the linker
+ * script symbols. On the host, the libfirmware is built without fw_mode.c
+ * and the mode is set at runtime instead: the storage functions then work
+ * on the bank which is not the running one, as on the device.
+ */
+void fw_host_set_mode(partitions_types running);
+
+#endif/*!FW_HOST_H_*/
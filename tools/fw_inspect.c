@@ -0,0 +1,343 @@
+/* \file fw_inspect.c
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+/*
+ * Offline inspector for raw flash dumps.
+ *
+ * For each dump given on the command line, the tool locates the FLIP and FLOP
+ * bootinfo headers (shr_vars_t), recomputes the SHR CRC32 the same way
+ * set_fw_header() does, checks the bootable flag and hashes both banks
+ * against the SHA256 stored in the header.
+ *
+ * Dumps are memory-mapped (no copy), several dumps are handled in parallel
+ * (-j) and, for each dump, the FLIP and FLOP banks are hashed concurrently.
+ *
+ * The dump is expected to be a raw image of the flash starting at the flash
+ * base address (-b, default 0x08000000).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "libc/types.h"
+#include "../fw_crc32.h"
+#include "sha256.h"
+/* the host autoconf.h and libsig.h give the Kconfig values and EC_MAX_SIGLEN,
+ * which can be overriden at build time */
+#include "shr.h"
+
+#define FLASH_BASE_ADDR 0x08000000
+
+/* t_firmware_signature fields offsets */
+#define SIG_OFF_MAGIC     0
+#define SIG_OFF_TYPE      4
+#define SIG_OFF_VERSION   8
+#define SIG_OFF_LEN       12
+#define SIG_OFF_SIGLEN    16
+#define SIG_OFF_CHUNKSIZE 20
+#define SIG_OFF_CRC32     24
+#define SIG_OFF_HASH      28
+#define SIG_OFF_SIG       (SIG_OFF_HASH + SHA256_DIGEST_SIZE)
+
+/* the CRC32 covers the two SHR sectors (fw_sig + fill, then bootable + residue) */
+#define SHR_CRC_AREA_SIZE (2 * SHR_SECTOR_SIZE)
+
+typedef struct {
+    const char *name;
+    uint32_t    shr_addr;
+    uint32_t    bank_addr;
+} bank_desc_t;
+
+static const bank_desc_t banks[2] = {
+    { "FLIP", CONFIG_USR_LIB_FIRMWARE_FLIP_BOOTINFO_ADDR, CONFIG_USR_LIB_FIRMWARE_FLIP_ADDR },
+    { "FLOP", CONFIG_USR_LIB_FIRMWARE_FLOP_BOOTINFO_ADDR, CONFIG_USR_LIB_FIRMWARE_FLOP_ADDR },
+};
+
+typedef struct {
+    /* input */
+    const uint8_t     *dump;
+    size_t             dump_len;
+    const bank_desc_t *bank;
+    /* output */
+    bool     shr_present;
+    bool     crc_ok;
+    bool     bootable;
+    bool     hash_checked;
+    bool     hash_ok;
+    uint32_t version;
+    uint32_t len;
+    uint32_t crc_stored;
+    uint32_t crc_computed;
+} bank_report_t;
+
+static uint32_t flash_base = FLASH_BASE_ADDR;
+static uint32_t ec_max_siglen = EC_MAX_SIGLEN;
+static bool     verbose = false;
+
+static char    **dumps;
+static int       dumps_num;
+static int       next_dump = 0;
+static int       failures = 0;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* the device is little endian, do not depend on the host one */
+static inline uint32_t get_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*
+ * Recompute the SHR CRC32 the way set_fw_header() does: the CRC32 field is
+ * replaced by 0xffffffff and the signature is not part of the CRC (replaced
+ * by 0xff), the remaining of the two SHR sectors is taken as is.
+ */
+static uint32_t shr_crc(const uint8_t *shr)
+{
+    uint8_t  fields[SIG_OFF_HASH];
+    uint32_t sig_size = SIG_OFF_SIG + ec_max_siglen;
+    uint32_t crc;
+
+    memcpy(fields, shr, sizeof(fields));
+    memset(&fields[SIG_OFF_CRC32], 0xff, sizeof(uint32_t));
+
+    crc = crc32(fields, sizeof(fields), 0xffffffff);
+    crc = crc32(shr + SIG_OFF_HASH, SHA256_DIGEST_SIZE, crc);
+    crc = crc32_erased(ec_max_siglen, crc);
+    crc = crc32(shr + sig_size, SHR_CRC_AREA_SIZE - sig_size, crc);
+    return crc;
+}
+
+static void *inspect_bank(void *arg)
+{
+    bank_report_t *rep = (bank_report_t*)arg;
+    const bank_desc_t *bank = rep->bank;
+    uint64_t shr_off;
+    uint64_t bank_off;
+    const uint8_t *shr;
+
+    if (bank->shr_addr < flash_base || bank->bank_addr < flash_base) {
+        return NULL;
+    }
+    shr_off = bank->shr_addr - flash_base;
+    bank_off = bank->bank_addr - flash_base;
+    if (shr_off + SHR_CRC_AREA_SIZE > rep->dump_len) {
+        return NULL;
+    }
+    shr = rep->dump + shr_off;
+    rep->shr_present = true;
+
+    rep->version = get_le32(shr + SIG_OFF_VERSION);
+    rep->len = get_le32(shr + SIG_OFF_LEN);
+    rep->crc_stored = get_le32(shr + SIG_OFF_CRC32);
+    rep->crc_computed = shr_crc(shr);
+    rep->crc_ok = (rep->crc_stored == rep->crc_computed);
+    rep->bootable = (get_le32(shr + SHR_SECTOR_SIZE) == FW_BOOTABLE);
+
+    /* an erased or corrupted header can't be trusted for the bank length */
+    if (!rep->crc_ok || rep->len > CONFIG_USR_LIB_FIRMWARE_BANK_SIZE ||
+        bank_off + rep->len > rep->dump_len) {
+        return NULL;
+    }
+
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    sha256_context ctx;
+
+    sha256_init(&ctx);
+    sha256_update(&ctx, rep->dump + bank_off, rep->len);
+    sha256_final(&ctx, digest);
+    rep->hash_checked = true;
+    rep->hash_ok = (memcmp(digest, shr + SIG_OFF_HASH, SHA256_DIGEST_SIZE) == 0);
+
+    return NULL;
+}
+
+static bool report_ok(const bank_report_t *rep)
+{
+    return rep->shr_present && rep->crc_ok && rep->bootable && rep->hash_ok;
+}
+
+static void print_report(const char *path, const bank_report_t rep[2])
+{
+    pthread_mutex_lock(&lock);
+    printf("%s:", path);
+    for (int i = 0; i < 2; ++i) {
+        if (!rep[i].shr_present) {
+            printf(" %s=out-of-dump", rep[i].bank->name);
+            continue;
+        }
+        printf(" %s=%s", rep[i].bank->name, report_ok(&rep[i]) ? "ok" : "KO");
+        if (verbose || !report_ok(&rep[i])) {
+            printf("(version=%08x len=%x crc=%s bootable=%s hash=%s)",
+                   rep[i].version, rep[i].len,
+                   rep[i].crc_ok ? "ok" : "bad",
+                   rep[i].bootable ? "yes" : "no",
+                   rep[i].hash_checked ? (rep[i].hash_ok ? "ok" : "bad") : "n/a");
+        }
+    }
+    printf("\n");
+    pthread_mutex_unlock(&lock);
+}
+
+static int inspect_dump(const char *path)
+{
+    bank_report_t rep[2];
+    struct stat st;
+    uint8_t *dump;
+    pthread_t th;
+    int fd;
+    int ret = 1;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "%s: empty or unreadable dump\n", path);
+        goto err_close;
+    }
+    dump = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (dump == MAP_FAILED) {
+        fprintf(stderr, "%s: mmap: %s\n", path, strerror(errno));
+        goto err_close;
+    }
+    madvise(dump, st.st_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+
+    memset(rep, 0, sizeof(rep));
+    for (int i = 0; i < 2; ++i) {
+        rep[i].dump = dump;
+        rep[i].dump_len = st.st_size;
+        rep[i].bank = &banks[i];
+    }
+    /* hash FLOP in a helper thread while FLIP is handled here */
+    if (pthread_create(&th, NULL, inspect_bank, &rep[1]) != 0) {
+        inspect_bank(&rep[1]);
+        inspect_bank(&rep[0]);
+    } else {
+        inspect_bank(&rep[0]);
+        pthread_join(th, NULL);
+    }
+    print_report(path, rep);
+    ret = (report_ok(&rep[0]) && report_ok(&rep[1])) ? 0 : 1;
+
+    munmap(dump, st.st_size);
+err_close:
+    close(fd);
+    return ret;
+}
+
+static void *worker(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        int idx;
+        pthread_mutex_lock(&lock);
+        idx = next_dump++;
+        pthread_mutex_unlock(&lock);
+        if (idx >= dumps_num) {
+            break;
+        }
+        if (inspect_dump(dumps[idx]) != 0) {
+            pthread_mutex_lock(&lock);
+            failures++;
+            pthread_mutex_unlock(&lock);
+        }
+    }
+    return NULL;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-j jobs] [-b flash_base] [-s ec_max_siglen] [-v] dump...\n"
+            "  -j jobs          number of dumps inspected in parallel (default: online CPUs)\n"
+            "  -b flash_base    address of the first byte of the dumps (default: 0x%08x)\n"
+            "  -s ec_max_siglen EC_MAX_SIGLEN of the device libsig (default: %u)\n"
+            "  -v               print the details of valid banks too\n"
+            "Exit status is 0 when both banks of all the dumps are valid.\n",
+            prog, FLASH_BASE_ADDR, EC_MAX_SIGLEN);
+}
+
+int main(int argc, char **argv)
+{
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    pthread_t *th;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:b:s:vh")) != -1) {
+        switch (opt) {
+            case 'j':
+                jobs = strtol(optarg, NULL, 0);
+                break;
+            case 'b':
+                flash_base = strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                ec_max_siglen = strtoul(optarg, NULL, 0);
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (optind >= argc || SIG_OFF_SIG + ec_max_siglen > SHR_SECTOR_SIZE) {
+        usage(argv[0]);
+        return 2;
+    }
+    dumps = &argv[optind];
+    dumps_num = argc - optind;
+    if (jobs < 1) {
+        jobs = 1;
+    }
+    if (jobs > dumps_num) {
+        jobs = dumps_num;
+    }
+
+    th = calloc(jobs, sizeof(pthread_t));
+    if (th == NULL) {
+        return 2;
+    }
+    for (long i = 0; i < jobs; ++i) {
+        if (pthread_create(&th[i], NULL, worker, NULL) != 0) {
+            jobs = i;
+            break;
+        }
+    }
+    /* at least the main thread does the job */
+    worker(NULL);
+    for (long i = 0; i < jobs; ++i) {
+        pthread_join(th[i], NULL);
+    }
+    free(th);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,342 @@
+/* \file fw_stage.c
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+/*
+ * Host-side flash image staging.
+ *
+ * For each firmware file given on the command line (raw header, signature,
+ * then firmware content), the tool writes the firmware into its target bank
+ * of the flash image and commits the bank bootinfo header, using the
+ * libfirmware storage and header functions the device runs, on top of the
+ * memory-mapped file storage backend. The bank is then verified.
+ *
+ * The flash image is a raw image of the flash starting at the flash base
+ * address (-b, default 0x08000000). It is created (erased) if needed.
+ * The library holds a single storage backend: to stage many images, run
+ * several instances in parallel, one per image.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "autoconf.h"
+#include "libc/types.h"
+#include "api/libfw.h"
+#include "libsig.h"
+#include "shr.h"
+#include "fw_storage.h"
+#include "fw_host.h"
+
+#define FLASH_BASE_ADDR   0x08000000
+#define FLASH_SIZE        0x200000
+/* the smallest flash sector size, so that bootinfo sectors can be erased */
+#define FLASH_SECTOR_SIZE 0x4000
+
+/* write granularity, as chunks are received on the device */
+#define STAGE_CHUNK_SIZE  4096
+
+static uint32_t flash_base = FLASH_BASE_ADDR;
+static uint32_t flash_size = FLASH_SIZE;
+static uint32_t sector_size = FLASH_SECTOR_SIZE;
+/* encrypted images key */
+static uint8_t  key[32];
+static uint32_t keylen = 0;
+
+static int parse_key(const char *hex)
+{
+    size_t len = strlen(hex);
+
+    if (len != 32 && len != 48 && len != 64) {
+        return 1;
+    }
+    for (size_t i = 0; i < len / 2; ++i) {
+        if (sscanf(hex + (2 * i), "%2hhx", &key[i]) != 1) {
+            return 1;
+        }
+    }
+    keylen = len / 2;
+    return 0;
+}
+
+static int stage_firmware(const char *path)
+{
+    firmware_header_t header;
+    uint8_t sig[EC_MAX_SIGLEN];
+    uint8_t hash[SHA256_DIGEST_SIZE];
+    uint8_t check[SHA256_DIGEST_SIZE];
+    firmware_sector_digest_t digests[FW_SECTOR_DIFF_MAX];
+    fw_sector_diff_t diff;
+    uint32_t count = 0;
+    uint32_t offset = 0;
+    fw_decrypt_t dec;
+    bool encrypted = false;
+    uint64_t avail;
+    sha256_context ctx;
+    partitions_types bank;
+    physaddr_t base;
+    physaddr_t shr;
+    uint8_t *payload;
+    const uint8_t *content;
+    struct stat st;
+    uint8_t *buf;
+    uint32_t bad_block;
+    int ret = 1;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "%s: unable to open\n", path);
+        goto err_open;
+    }
+    /* private writable mapping: encrypted payloads are decrypted in place */
+    buf = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (buf == MAP_FAILED) {
+        fprintf(stderr, "%s: unable to map\n", path);
+        goto err_open;
+    }
+    if (firmware_parse_header(buf, st.st_size, sizeof(sig), &header, sig) != 0) {
+        fprintf(stderr, "%s: invalid header\n", path);
+        goto err;
+    }
+    if (firmware_is_sparse(&header) || firmware_is_merkle(&header)) {
+        fprintf(stderr, "%s: sparse and hash-tree images are not supported\n", path);
+        goto err;
+    }
+    if (firmware_is_partition_flip(&header)) {
+        bank = PART_FLIP;
+        base = firmware_get_flip_base_addr();
+        shr = CONFIG_USR_LIB_FIRMWARE_FLIP_BOOTINFO_ADDR;
+        /* the flip bank is updated from the flop one */
+        fw_host_set_mode(PART_FLOP);
+    } else if (firmware_is_partition_flop(&header)) {
+        bank = PART_FLOP;
+        base = firmware_get_flop_base_addr();
+        shr = CONFIG_USR_LIB_FIRMWARE_FLOP_BOOTINFO_ADDR;
+        fw_host_set_mode(PART_FLIP);
+    } else {
+        fprintf(stderr, "%s: unknown target partition\n", path);
+        goto err;
+    }
+    payload = buf + sizeof(firmware_header_t) + header.siglen;
+    avail = (uint64_t)st.st_size - sizeof(firmware_header_t) - header.siglen;
+    encrypted = firmware_is_encrypted(&header);
+    if (encrypted && (keylen == 0 || fw_decrypt_init(&dec, &header, key, keylen))) {
+        fprintf(stderr, "%s: encrypted image, a valid key is required\n", path);
+        goto err;
+    }
+    if (firmware_is_sector_diff(&header)) {
+        if (encrypted && avail >= sizeof(uint32_t)) {
+            /* decrypt the manifest count, then the digests */
+            uint32_t num;
+            fw_decrypt(&dec, 0, payload, sizeof(uint32_t));
+            memcpy(&num, payload, sizeof(uint32_t));
+            num = ntohl(num);
+            if (num <= FW_SECTOR_DIFF_MAX && avail >= FW_SECTOR_MANIFEST_SIZE(num)) {
+                fw_decrypt(&dec, sizeof(uint32_t), payload + sizeof(uint32_t),
+                           num * sizeof(firmware_sector_digest_t));
+            }
+        }
+        if (firmware_parse_sector_manifest(payload, avail, &header, digests,
+                                           FW_SECTOR_DIFF_MAX, &count) != 0) {
+            fprintf(stderr, "%s: invalid sector manifest\n", path);
+            goto err;
+        }
+        payload += FW_SECTOR_MANIFEST_SIZE(count);
+        avail -= FW_SECTOR_MANIFEST_SIZE(count);
+        offset = FW_SECTOR_MANIFEST_SIZE(count);
+    }
+    if (header.len == 0 || header.len > CONFIG_USR_LIB_FIRMWARE_BANK_SIZE ||
+        avail < header.len) {
+        fprintf(stderr, "%s: invalid firmware len\n", path);
+        goto err;
+    }
+
+    /* same sequence as the device updater, the bank erase being scheduled
+     * along with the chunks writes */
+    if (fw_storage_prepare_access()) {
+        fprintf(stderr, "%s: unable to prepare bank\n", path);
+        goto err;
+    }
+    if (count ? fw_storage_diff_start(&diff, digests, count) : fw_storage_erase_start()) {
+        fprintf(stderr, "%s: unable to erase bank\n", path);
+        fw_storage_release_access();
+        goto err;
+    }
+    /* the committed hash is the one of the source payload, which the
+     * signature covers */
+    sha256_init(&ctx);
+    for (uint32_t off = 0; off < header.len; off += STAGE_CHUNK_SIZE) {
+        uint32_t todo = header.len - off;
+        if (todo > STAGE_CHUNK_SIZE) {
+            todo = STAGE_CHUNK_SIZE;
+        }
+        /* on the device, the next chunk would be received here */
+        if (fw_storage_erase_poll(1) ||
+            (encrypted ?
+             fw_storage_write_decrypt(&dec, offset + off, base + off, (uint32_t*)(payload + off), todo) :
+             fw_storage_write_buffer(base + off, (uint32_t*)(payload + off), todo))) {
+            fprintf(stderr, "%s: write error at offset %x\n", path, off);
+            fw_storage_release_access();
+            goto err;
+        }
+        /* encrypted chunks are decrypted in place by the write */
+        sha256_update(&ctx, payload + off, todo);
+    }
+    sha256_final(&ctx, hash);
+#if CONFIG_USR_LIB_FIRMWARE_WRITE_HASH
+    /* the programmed content, hashed while writing, must be the source one */
+    if (fw_storage_get_hash(header.len, check) ||
+        memcmp(hash, check, SHA256_DIGEST_SIZE) != 0) {
+        fprintf(stderr, "%s: programmed content doesn't match the payload\n", path);
+        fw_storage_release_access();
+        goto err;
+    }
+#endif
+    if (fw_storage_finalize_access()) {
+        fprintf(stderr, "%s: unable to finalize bank\n", path);
+        goto err;
+    }
+#if !CONFIG_USR_LIB_FIRMWARE_SHR_LOG
+    /* the bootinfo header is written in erased SHR sectors (the image may
+     * have been staged before) */
+    if (fw_storage_erase_range(shr, 2 * SHR_SECTOR_SIZE)) {
+        fprintf(stderr, "%s: unable to erase bootinfo\n", path);
+        goto err;
+    }
+#else
+    (void)shr;
+#endif
+    if (set_fw_header(&header, sig, hash)) {
+        fprintf(stderr, "%s: unable to write bootinfo header\n", path);
+        goto err;
+    }
+
+    /* validate the staged bank, directly on the image mapping */
+#if !CONFIG_USR_LIB_FIRMWARE_SHR_LOG
+    (void)content;
+    (void)check;
+    if (fw_bank_verify_hash(bank, &bad_block)) {
+        if (bad_block == 0xffffffff) {
+            fprintf(stderr, "%s: staged bank hash mismatch\n", path);
+        } else {
+            fprintf(stderr, "%s: staged bank block %u corrupted\n", path, bad_block);
+        }
+        goto err;
+    }
+#else
+    (void)bad_block;
+    content = fw_storage_addr(base);
+    if (content == NULL) {
+        goto err;
+    }
+    sha256_init(&ctx);
+    sha256_update(&ctx, content, header.len);
+    sha256_final(&ctx, check);
+    if (memcmp(hash, check, SHA256_DIGEST_SIZE) != 0) {
+        fprintf(stderr, "%s: staged bank hash mismatch\n", path);
+        goto err;
+    }
+#endif
+    printf("%s: %s bank staged (version %08x, %u bytes", path,
+           (bank == PART_FLIP) ? "FLIP" : "FLOP", header.version, header.len);
+    if (count) {
+        printf(", %u/%u identical sectors", diff.skipped, count);
+    }
+    printf(")\n");
+    ret = 0;
+
+err:
+    if (encrypted) {
+        fw_decrypt_clear(&dec);
+    }
+    munmap(buf, st.st_size);
+err_open:
+    if (fd >= 0) {
+        close(fd);
+    }
+    return ret;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-b flash_base] [-S flash_size] [-e sector_size] [-k key] image firmware...\n"
+            "  -b flash_base  address of the first byte of the image (default: 0x%08x)\n"
+            "  -S flash_size  image size (default: 0x%x)\n"
+            "  -e sector_size erase granularity (default: 0x%x)\n"
+            "  -k key         AES key of encrypted images (hexadecimal, 128 to 256 bits)\n"
+            "Each firmware (raw header, signature and content) is staged in its\n"
+            "target bank of the image, which is created if needed.\n",
+            prog, FLASH_BASE_ADDR, FLASH_SIZE, FLASH_SECTOR_SIZE);
+}
+
+int main(int argc, char **argv)
+{
+    int failures = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:S:e:k:h")) != -1) {
+        switch (opt) {
+            case 'b':
+                flash_base = strtoul(optarg, NULL, 0);
+                break;
+            case 'S':
+                flash_size = strtoul(optarg, NULL, 0);
+                break;
+            case 'e':
+                sector_size = strtoul(optarg, NULL, 0);
+                break;
+            case 'k':
+                if (parse_key(optarg)) {
+                    usage(argv[0]);
+                    return 2;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (optind + 2 > argc) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (fw_storage_file_open(argv[optind], flash_base, flash_size, sector_size) ||
+        fw_storage_set_backend(&fw_storage_file_ops)) {
+        fprintf(stderr, "%s: unable to open image\n", argv[optind]);
+        return 2;
+    }
+    for (int i = optind + 1; i < argc; ++i) {
+        if (stage_firmware(argv[i])) {
+            failures++;
+        }
+    }
+    if (fw_storage_file_close()) {
+        return 2;
+    }
+    return failures ? 1 : 0;
+}
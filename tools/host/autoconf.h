@@ -0,0 +1,56 @@
+/* \file autoconf.h
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+#ifndef HOST_AUTOCONF_H_
+#define HOST_AUTOCONF_H_
+
+/*
+ * Host replacement of the generated Kconfig header. Default values are the
+ * Kconfig ones, and can be overriden at build time (FW_CFLAGS).
+ */
+#ifndef CONFIG_USR_LIB_FIRMWARE_FLIP_ADDR
+# define CONFIG_USR_LIB_FIRMWARE_FLIP_ADDR 0x08020000
+#endif
+#ifndef CONFIG_USR_LIB_FIRMWARE_FLOP_ADDR
+# define CONFIG_USR_LIB_FIRMWARE_FLOP_ADDR 0x08120000
+#endif
+#ifndef CONFIG_USR_LIB_FIRMWARE_FLIP_BOOTINFO_ADDR
+# define CONFIG_USR_LIB_FIRMWARE_FLIP_BOOTINFO_ADDR 0x08008000
+#endif
+#ifndef CONFIG_USR_LIB_FIRMWARE_FLOP_BOOTINFO_ADDR
+# define CONFIG_USR_LIB_FIRMWARE_FLOP_BOOTINFO_ADDR 0x08108000
+#endif
+#ifndef CONFIG_USR_LIB_FIRMWARE_BANK_SIZE
+# define CONFIG_USR_LIB_FIRMWARE_BANK_SIZE 0xe0000
+#endif
+#ifndef CONFIG_USR_LIB_FIRMWARE_WRITE_HASH
+# define CONFIG_USR_LIB_FIRMWARE_WRITE_HASH 1
+#endif
+#ifndef CONFIG_USR_LIB_FIRMWARE_CHUNK_POOL
+# define CONFIG_USR_LIB_FIRMWARE_CHUNK_POOL 1
+# define CONFIG_USR_LIB_FIRMWARE_CHUNK_POOL_NUM 2
+# define CONFIG_USR_LIB_FIRMWARE_CHUNK_POOL_SIZE 4096
+#endif
+
+/* no flash driver on the host: the storage backend must be set explicitly */
+
+#endif/*!HOST_AUTOCONF_H_*/
@@ -0,0 +1,40 @@
+/* \file stdio.h
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+#ifndef HOST_LIBC_STDIO_H_
+#define HOST_LIBC_STDIO_H_
+
+/*
+ * Host replacement of the EwoK libstd stdio header.
+ */
+#include <stdio.h>
+#include <stdint.h>
+
+static inline void hexdump(const uint8_t *bufp, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; ++i) {
+        printf("%02x ", bufp[i]);
+    }
+    printf("\n");
+}
+
+#endif/*!HOST_LIBC_STDIO_H_*/
@@ -0,0 +1,44 @@
+/* \file types.h
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+#ifndef HOST_LIBC_TYPES_H_
+#define HOST_LIBC_TYPES_H_
+
+/*
+ * Host replacement of the EwoK libstd types header, used to build the
+ * libfirmware sources that are shared with the host tools.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef uint32_t physaddr_t;
+
+#ifndef __packed
+# define __packed __attribute__((packed))
+#endif
+
+#define __in
+#define __out
+#define __inout
+
+#endif/*!HOST_LIBC_TYPES_H_*/
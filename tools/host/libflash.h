@@ -0,0 +1,36 @@
+/* \file libflash.h
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+#ifndef HOST_LIBFLASH_H_
+#define HOST_LIBFLASH_H_
+
+/*
+ * Host replacement of the flash driver API. Only the types used by the
+ * libfirmware API are provided, the flash backend not being built.
+ */
+#include "libc/types.h"
+
+typedef struct {
+    bool unused;
+} t_device_mapping;
+
+#endif/*!HOST_LIBFLASH_H_*/
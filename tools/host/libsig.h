@@ -0,0 +1,37 @@
+/* \file libsig.h
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+#ifndef HOST_LIBSIG_H_
+#define HOST_LIBSIG_H_
+
+/*
+ * Host replacement of libsig: SHA256 is provided by the host tools minimal
+ * implementation, which mimics the libecc API.
+ */
+#include "sha256.h"
+
+/* libsig EC_MAX_SIGLEN of the device build (libecc configuration dependent) */
+#ifndef EC_MAX_SIGLEN
+# define EC_MAX_SIGLEN 64
+#endif
+
+#endif/*!HOST_LIBSIG_H_*/
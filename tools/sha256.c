@@ -0,0 +1,134 @@
+/* \file sha256.c
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+#include <string.h>
+#include "sha256.h"
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define CH(x, y, z)  (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define S0(x) (ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define S1(x) (ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define s0(x) (ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define s1(x) (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+
+static void sha256_process(sha256_context *ctx, const uint8_t *data)
+{
+    uint32_t w[64];
+    uint32_t a, b, c, d, e, f, g, h, t1, t2;
+    uint32_t i;
+
+    for (i = 0; i < 16; ++i) {
+        w[i] = ((uint32_t)data[4 * i] << 24) | ((uint32_t)data[4 * i + 1] << 16) |
+               ((uint32_t)data[4 * i + 2] << 8) | (uint32_t)data[4 * i + 3];
+    }
+    for (i = 16; i < 64; ++i) {
+        w[i] = s1(w[i - 2]) + w[i - 7] + s0(w[i - 15]) + w[i - 16];
+    }
+    a = ctx->state[0]; b = ctx->state[1]; c = ctx->state[2]; d = ctx->state[3];
+    e = ctx->state[4]; f = ctx->state[5]; g = ctx->state[6]; h = ctx->state[7];
+    for (i = 0; i < 64; ++i) {
+        t1 = h + S1(e) + CH(e, f, g) + K[i] + w[i];
+        t2 = S0(a) + MAJ(a, b, c);
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    ctx->state[0] += a; ctx->state[1] += b; ctx->state[2] += c; ctx->state[3] += d;
+    ctx->state[4] += e; ctx->state[5] += f; ctx->state[6] += g; ctx->state[7] += h;
+}
+
+int sha256_init(sha256_context *ctx)
+{
+    static const uint32_t iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    if (ctx == NULL) {
+        return -1;
+    }
+    ctx->total = 0;
+    memcpy(ctx->state, iv, sizeof(iv));
+    return 0;
+}
+
+int sha256_update(sha256_context *ctx, const uint8_t *input, uint32_t ilen)
+{
+    uint32_t fill;
+
+    if ((ctx == NULL) || ((input == NULL) && (ilen != 0))) {
+        return -1;
+    }
+    fill = (uint32_t)(ctx->total % SHA256_BLOCK_SIZE);
+    ctx->total += ilen;
+    if (fill && (ilen >= (SHA256_BLOCK_SIZE - fill))) {
+        memcpy(ctx->buffer + fill, input, SHA256_BLOCK_SIZE - fill);
+        sha256_process(ctx, ctx->buffer);
+        input += SHA256_BLOCK_SIZE - fill;
+        ilen  -= SHA256_BLOCK_SIZE - fill;
+        fill = 0;
+    }
+    while (ilen >= SHA256_BLOCK_SIZE) {
+        sha256_process(ctx, input);
+        input += SHA256_BLOCK_SIZE;
+        ilen  -= SHA256_BLOCK_SIZE;
+    }
+    if (ilen) {
+        memcpy(ctx->buffer + fill, input, ilen);
+    }
+    return 0;
+}
+
+int sha256_final(sha256_context *ctx, uint8_t output[SHA256_DIGEST_SIZE])
+{
+    uint8_t  pad[SHA256_BLOCK_SIZE + 8] = { 0x80 };
+    uint64_t bits;
+    uint32_t fill, padlen, i;
+
+    if ((ctx == NULL) || (output == NULL)) {
+        return -1;
+    }
+    bits = ctx->total << 3;
+    fill = (uint32_t)(ctx->total % SHA256_BLOCK_SIZE);
+    padlen = (fill < 56) ? (56 - fill) : (120 - fill);
+    for (i = 0; i < 8; ++i) {
+        pad[padlen + i] = (uint8_t)(bits >> (56 - 8 * i));
+    }
+    sha256_update(ctx, pad, padlen + 8);
+    for (i = 0; i < 8; ++i) {
+        output[4 * i]     = (uint8_t)(ctx->state[i] >> 24);
+        output[4 * i + 1] = (uint8_t)(ctx->state[i] >> 16);
+        output[4 * i + 2] = (uint8_t)(ctx->state[i] >> 8);
+        output[4 * i + 3] = (uint8_t)(ctx->state[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,47 @@
+/* \file sha256.h
+ *
+ * Copyright 2018 The wookey project team <wookey@ssi.gouv.fr>
+ *   - Ryad     Benadjila
+ *   - Arnauld  Michelizza
+ *   - Mathieu  Renard
+ *   - Philippe Thierry
+ *   - Philippe Trebuchet
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ *
+ */
+#ifndef HOST_SHA256_H_
+#define HOST_SHA256_H_
+
+/*
+ * Minimal SHA-256 for the host tools. The API mimics the libecc one used
+ * on the device (through libsig) so that shared code can use both.
+ */
+#include <stdint.h>
+
+#define SHA256_DIGEST_SIZE 32
+#define SHA256_BLOCK_SIZE  64
+
+typedef struct {
+    uint64_t total;
+    uint32_t state[8];
+    uint8_t  buffer[SHA256_BLOCK_SIZE];
+} sha256_context;
+
+int sha256_init(sha256_context *ctx);
+
+int sha256_update(sha256_context *ctx, const uint8_t *input, uint32_t ilen);
+
+int sha256_final(sha256_context *ctx, uint8_t output[SHA256_DIGEST_SIZE]);
+
+#endif/*!HOST_SHA256_H_*/
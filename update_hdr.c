@@ -3,46 +3,73 @@
 #include "libc/types.h"
 #include "autoconf.h"
 #include "shr.h"
-#include "libflash.h"
 #include "libhash.h"
 #include "libcryp.h"
-#include "libc/syscall.h"
 #include "libc/stdio.h"
 #include "libc/nostd.h"
 #include "libc/string.h"
 #include "fw_storage.h"
+#include "fw_digest.h"
+#include "fw_crc32.h"
+#include "fw_shr.h"
+#include "fw_sig_gate.h"
+
+/*
+ * About stack usage:
+ *
+ * The SHR (t_firmware_state) is more than 16KB long and the signature header
+ * holds an EC_MAX_SIGLEN signature buffer. None of them is forged in RAM:
+ * - the CRC32 of the erased parts of the SHR is calculated using
+ *   crc32_erased(), which advances the CRC register arithmetically in
+ *   O(log len) steps, without any 0xff buffer,
+ * - the header fields are forged in a small t_firmware_sig_fields structure,
+ *   the hash, the signature and the digest table being programmed directly
+ *   from the caller (or library) buffers,
+ * - the header is cleared by programming the read-only clear_pattern[] on
+ *   the only fields that make it valid.
+ * The clear_other_header() and set_fw_header() locals are then bounded to a
+ * few words (less than 64 bytes), whatever the SHR size and EC_MAX_SIGLEN.
+ */
+
+#if !CONFIG_USR_LIB_FIRMWARE_SHR_LOG
+static const uint32_t clear_pattern[16] = { 0 };
+
+/* program the clear pattern (zeroes) on size bytes at dest */
+static void clear_area(physaddr_t dest, uint32_t size)
+{
+    while (size) {
+        uint32_t todo = (size > sizeof(clear_pattern)) ? sizeof(clear_pattern) : size;
+        fw_storage_write_buffer(dest, (uint32_t*)clear_pattern, todo);
+        dest += todo;
+        size -= todo;
+    }
+}
+#endif
 
 /* clear the target DFU header (flip when in flop mode, flop when in flip mode */
 uint8_t clear_other_header(void)
 {
-    uint8_t ret;
-    int desc;
+    fw_storage_area_t shr_area = FW_STORAGE_FLOP_SHR;
     t_firmware_state * fw = 0;
     uint8_t ok = 0;
     shr_vars_t *shr_header = 0;
     if (is_in_flip_mode()) {
         shr_header = (shr_vars_t*)CONFIG_USR_LIB_FIRMWARE_FLOP_BOOTINFO_ADDR;
+        shr_area = FW_STORAGE_FLOP_SHR;
     }
     if (is_in_flop_mode()) {
         shr_header = (shr_vars_t*)CONFIG_USR_LIB_FIRMWARE_FLIP_BOOTINFO_ADDR;
+        shr_area = FW_STORAGE_FLIP_SHR;
     }
 
-    desc = flash_get_descriptor(CTRL2);
-    ret = sys_cfg(CFG_DEV_MAP, desc);
-    if (ret != SYS_E_DONE) {
+    /* map (and unlock) storage ctrl */
+    if (fw_storage_map(FW_STORAGE_CTRL2)) {
         printf("unable to map flash-ctrl device\n");
         ok = 1;
         goto initial_err;
     }
 
-    if (is_in_flip_mode()) {
-        desc = flash_get_descriptor(FLOP_SHR);
-    }
-    if (is_in_flop_mode()) {
-        desc = flash_get_descriptor(FLIP_SHR);
-    }
-    ret = sys_cfg(CFG_DEV_MAP, desc);
-    if (ret != SYS_E_DONE) {
+    if (fw_storage_map(shr_area)) {
         printf("unable to map flip-shr device, rollback\n");
         ok = 1;
         goto middle_err;
@@ -54,10 +81,6 @@ uint8_t clear_other_header(void)
     printf("shr_header size is %x\n", sizeof(shr_vars_t));
 #endif
 
-    uint8_t buff[sizeof(t_firmware_state)] = { 0xff };
-
-    flash_unlock();
-
     fw = &(shr_header->fw);
     /* flip and flop are *not* on the same sector */
     if (is_in_flip_mode()) {
@@ -70,28 +93,33 @@ uint8_t clear_other_header(void)
         printf("clearing FLIP header at @ %x\n", &shr_header->fw);
 #endif
     }
-    fw_storage_write_buffer((physaddr_t)fw, (uint32_t*)buff, sizeof(shr_vars_t));
-
-    flash_lock();
-
-    if (is_in_flip_mode()) {
-        desc = flash_get_descriptor(FLOP_SHR);
-    }
-    if (is_in_flop_mode()) {
-        desc = flash_get_descriptor(FLIP_SHR);
+#if CONFIG_USR_LIB_FIRMWARE_SHR_LOG
+    /* the newest record wins: append an invalidation record */
+    (void)fw;
+    if (fw_shr_log_append((physaddr_t)shr_header, NULL, NULL, NULL, FW_NOT_BOOTABLE)) {
+        ok = 1;
     }
+#else
+    /*
+     * Invalidating the header doesn't require to program the whole SHR:
+     * clearing the signature header (including its CRC32), the digest table
+     * header and the bootable flag is enough for both the bootloader and the
+     * libfirmware to consider the bank as invalid.
+     */
+    clear_area((physaddr_t)&fw->fw_sig, sizeof(t_firmware_signature));
+    clear_area((physaddr_t)&fw->digests, sizeof(t_firmware_digests) - sizeof(fw->digests.crc));
+    clear_area((physaddr_t)&fw->bootable, sizeof(uint32_t));
+#endif
 
-    ret = sys_cfg(CFG_DEV_UNMAP, desc);
-    if (ret != SYS_E_DONE) {
+    if (fw_storage_unmap(shr_area)) {
         printf("unable to map flip-shr device\n");
         return 1;
     }
 
 middle_err:
 
-    desc = flash_get_descriptor(CTRL2);
-    ret = sys_cfg(CFG_DEV_UNMAP, desc);
-    if (ret != SYS_E_DONE) {
+    /* lock and unmap storage ctrl */
+    if (fw_storage_unmap(FW_STORAGE_CTRL2)) {
         printf("unable to map flash-ctrl device\n");
         return 1;
     }
@@ -112,37 +140,34 @@ initial_err:
 #endif
 uint8_t set_fw_header(const firmware_header_t *dfu_header, const uint8_t *sig, const uint8_t *hash)
 {
-    uint8_t ret;
-    int desc;
+    fw_storage_area_t shr_area = FW_STORAGE_FLOP_SHR;
     t_firmware_state * fw = 0;
     uint8_t ok = 0;
     shr_vars_t *shr_header = 0;
     if (is_in_flip_mode()) {
         shr_header = (shr_vars_t*)CONFIG_USR_LIB_FIRMWARE_FLOP_BOOTINFO_ADDR;
+        shr_area = FW_STORAGE_FLOP_SHR;
     }
     if (is_in_flop_mode()) {
         shr_header = (shr_vars_t*)CONFIG_USR_LIB_FIRMWARE_FLIP_BOOTINFO_ADDR;
+        shr_area = FW_STORAGE_FLIP_SHR;
     }
 
+    /* a speculative update is committed only once its signature is verified */
+    if (fw_sig_gate_check(dfu_header, sig, hash, false)) {
+        return 1;
+    }
 
     /*unmap hash if mapped */
     hash_unmap();
     /* map SHR */
-    desc = flash_get_descriptor(CTRL2);
-    ret = sys_cfg(CFG_DEV_MAP, desc);
-    if (ret != SYS_E_DONE) {
+    /* map (and unlock) storage ctrl */
+    if (fw_storage_map(FW_STORAGE_CTRL2)) {
         printf("unable to map flash-ctrl device\n");
         ok = 1;
         goto initial_err;
     }
-    if (is_in_flip_mode()) {
-        desc = flash_get_descriptor(FLOP_SHR);
-    }
-    if (is_in_flop_mode()) {
-        desc = flash_get_descriptor(FLIP_SHR);
-    }
-    ret = sys_cfg(CFG_DEV_MAP, desc);
-    if (ret != SYS_E_DONE) {
+    if (fw_storage_map(shr_area)) {
         printf("unable to map flip-shr device\n");
         ok = 1;
         goto middle_err;
@@ -156,80 +181,92 @@ uint8_t set_fw_header(const firmware_header_t *dfu_header, const uint8_t *sig, c
         goto final_err;
     }
     uint32_t crc;
-    t_firmware_signature tmp_fw;
-    memset((uint8_t*)&tmp_fw, 0xff, sizeof(t_firmware_signature));
+    t_firmware_sig_fields fields;
+    const t_firmware_digests *digests;
     uint32_t bootable = FW_BOOTABLE;
 
+    if (dfu_header->siglen > EC_MAX_SIGLEN) {
+        printf("Error! signature too long !\n");
+        ok = 1;
+        goto final_err;
+    }
+#if CONFIG_USR_LIB_FIRMWARE_SHR_LOG
+    /* log-structured bootinfo: a new record is appended, no erase needed */
+    (void)crc;
+    (void)fields;
+    (void)digests;
+    printf("appending header record in @%x\n", fw);
+    if (fw_shr_log_append((physaddr_t)shr_header, dfu_header, sig, hash, bootable)) {
+        ok = 1;
+    }
+#else
+    /* per-block CRC32 table calculated while the bank was written, if any */
+    digests = fw_digest_get(dfu_header->len);
+
     /* TODO: fw should be written in 2 times (in RAM, to set the CRC32, and
      * written to flash in atomic mode */
-    tmp_fw.magic = dfu_header->magic;
-    tmp_fw.type = dfu_header->type;
-    tmp_fw.version = dfu_header->version;
-    tmp_fw.len = dfu_header->len;
-    tmp_fw.siglen = dfu_header->siglen;
-    tmp_fw.chunksize = dfu_header->chunksize;
-    memcpy((void*)tmp_fw.sig, sig, tmp_fw.siglen);
-    memcpy((void*)tmp_fw.hash, hash, SHA256_DIGEST_SIZE);
-    //tmp_fw.bootable = FW_BOOTABLE;
+    fields.magic = dfu_header->magic;
+    fields.type = dfu_header->type;
+    fields.version = dfu_header->version;
+    fields.len = dfu_header->len;
+    fields.siglen = dfu_header->siglen;
+    fields.chunksize = dfu_header->chunksize;
 
     /* CRC32 field is not checked for CRC32. We use it as tmp buf to calculate
      * the CRC32 of the overall SHR sectors (2 sectors) which must contain, at
      * boot, only 0xfffff out of the signature header, as these sectors
      * have been erased */
-    tmp_fw.crc32 = 0xffffffff;
+    fields.crc32 = 0xffffffff;
 
     /* set the signature header CRC32 (with the CRC32 field set at 0xffffffff) */
-    crc = crc32((uint8_t*)&tmp_fw, sizeof(t_firmware_signature) - SHA256_DIGEST_SIZE - EC_MAX_SIGLEN, 0xffffffff);
+    crc = crc32((uint8_t*)&fields, sizeof(t_firmware_sig_fields), 0xffffffff);
 
-    crc = crc32((uint8_t*)tmp_fw.hash, SHA256_DIGEST_SIZE, crc);
+    crc = crc32(hash, SHA256_DIGEST_SIZE, crc);
     /* signature is not a part of the CRC, we use 0xff...ff instead */
-    for (uint32_t i = 0; i < EC_MAX_SIGLEN; ++i) {
-        crc = crc32((uint8_t*)&tmp_fw.crc32, sizeof(uint8_t), crc);
+    crc = crc32_erased(EC_MAX_SIGLEN, crc);
+    /* then the digest table, or 0xff...ff if there is no table */
+    if (digests) {
+        crc = crc32((uint8_t*)digests, sizeof(t_firmware_digests), crc);
+    } else {
+        crc = crc32_erased(sizeof(t_firmware_digests), crc);
     }
     /* equivalent to calculcating CRC32 of 0xffff of 'fill' field of the header */
-    for (uint32_t i = 0; i < (SHR_SECTOR_SIZE - sizeof(t_firmware_signature)); ++i) {
-        crc = crc32((uint8_t*)&tmp_fw.crc32, sizeof(uint8_t), crc);
-    }
+    crc = crc32_erased(sizeof(fw->fill), crc);
     /* finishing with boot flag crc32 */
     crc = crc32((uint8_t*)&bootable, sizeof(uint32_t), crc);
-    /* and the vfill residue of the 2nd sector (using crc32 as temp buffer
-     * containing 0xffffffff content */
-    for (uint32_t i = 0; i < (SHR_SECTOR_SIZE - sizeof(uint32_t)); ++i) {
-        crc = crc32((uint8_t*)&tmp_fw.crc32, sizeof(uint8_t), crc);
-    }
+    /* and the vfill residue of the 2nd sector */
+    crc = crc32_erased(SHR_SECTOR_SIZE - sizeof(uint32_t), crc);
     /* update the crc32 field with the calculated CRC */
-    tmp_fw.crc32 = crc;
-
-    flash_unlock();
+    fields.crc32 = crc;
 
+    /* the bootable flag is written last, once the whole header is written */
     printf("writing header singature :@%x\n", fw);
-    fw_storage_write_buffer((physaddr_t)fw, (uint32_t*)&tmp_fw, sizeof(t_firmware_signature));
+    fw_storage_write_buffer((physaddr_t)fw, (uint32_t*)&fields, sizeof(t_firmware_sig_fields));
+    fw_storage_write_buffer((physaddr_t)fw->fw_sig.hash, (uint32_t*)hash, SHA256_DIGEST_SIZE);
+    fw_storage_write_buffer((physaddr_t)fw->fw_sig.sig, (uint32_t*)sig, dfu_header->siglen);
+    if (digests) {
+        printf("writing header digests :@%x\n", (uint32_t)&fw->digests);
+        fw_storage_write_buffer((physaddr_t)&fw->digests, (uint32_t*)digests, sizeof(t_firmware_digests));
+    }
     printf("writing header bootflag :@%x\n", (uint32_t)&fw->bootable);
     fw_storage_write_buffer((physaddr_t)&fw->bootable, (uint32_t*)&bootable, sizeof(uint32_t));
-
-    flash_lock();
+#endif
+    if (!ok) {
+        fw_sig_gate_done();
+    }
 
     /* unmapping and rollback management */
 final_err:
 
-    if (is_in_flip_mode()) {
-        desc = flash_get_descriptor(FLOP_SHR);
-    }
-    if (is_in_flop_mode()) {
-        desc = flash_get_descriptor(FLIP_SHR);
-    }
-
-    ret = sys_cfg(CFG_DEV_UNMAP, desc);
-    if (ret != SYS_E_DONE) {
+    if (fw_storage_unmap(shr_area)) {
         printf("unable to map flip-shr device\n");
         return ok;
     }
 
 middle_err:
 
-    desc = flash_get_descriptor(CTRL2);
-    ret = sys_cfg(CFG_DEV_UNMAP, desc);
-    if (ret != SYS_E_DONE) {
+    /* lock and unmap storage ctrl */
+    if (fw_storage_unmap(FW_STORAGE_CTRL2)) {
         printf("unable to map flash-ctrl device\n");
         return ok;
     }